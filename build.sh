@@ -17,9 +17,9 @@ echo "Detected OS: $OS_ID"
 echo ""
 
 echo "Required dependencies:"
-echo "  - wlroots (>= 0.17)"
+echo "  - wlroots (>= 0.17, 0.19 for ext-image-copy-capture)"
 echo "  - wayland, wayland-protocols"
-echo "  - libxkbcommon, libinput, pixman"
+echo "  - libxkbcommon, libinput, pixman, libpng, freetype2, fontconfig"
 echo "  - mesa/libdrm/gbm, seatd"
 echo ""
 
@@ -29,21 +29,21 @@ case "$OS_ID" in
         echo "  sudo apt update"
         echo "  sudo apt install -y build-essential pkg-config wayland-scanner"
         echo "  sudo apt install -y libwlroots-dev wayland-protocols libwayland-dev"
-        echo "  sudo apt install -y libxkbcommon-dev libinput-dev libpixman-1-dev"
+        echo "  sudo apt install -y libxkbcommon-dev libinput-dev libpixman-1-dev libpng-dev libfreetype-dev libfontconfig-dev"
         echo "  sudo apt install -y libdrm-dev libgbm-dev libegl1-mesa-dev seatd libseat-dev"
         ;;
     arch|manjaro)
         echo "Install dependencies (Arch Linux):"
         echo "  sudo pacman -Syu --needed base-devel pkg-config"
         echo "  sudo pacman -S --needed wlroots wayland wayland-protocols"
-        echo "  sudo pacman -S --needed libxkbcommon libinput pixman mesa seatd"
+        echo "  sudo pacman -S --needed libxkbcommon libinput pixman libpng freetype2 fontconfig mesa seatd"
         ;;
     fedora|rhel|centos|rocky|almalinux)
         echo "Install dependencies (Fedora/RHEL/Rocky/CentOS):"
         echo "  sudo dnf groupinstall -y 'Development Tools'"
         echo "  sudo dnf install -y pkg-config wayland-devel wayland-scanner"
         echo "  sudo dnf install -y wlroots-devel wayland-protocols-devel"
-        echo "  sudo dnf install -y libxkbcommon-devel libinput-devel pixman-devel"
+        echo "  sudo dnf install -y libxkbcommon-devel libinput-devel pixman-devel libpng-devel freetype-devel fontconfig-devel"
         echo "  sudo dnf install -y mesa-libEGL-devel mesa-libgbm-devel libdrm-devel"
         echo "  sudo dnf install -y seatd seatd-devel"
         ;;
@@ -52,19 +52,19 @@ case "$OS_ID" in
         echo "  sudo zypper install -y -t pattern devel_basis"
         echo "  sudo zypper install -y pkg-config wlroots-devel wayland-devel"
         echo "  sudo zypper install -y wayland-protocols-devel libxkbcommon-devel"
-        echo "  sudo zypper install -y libinput-devel libpixman-1-0-devel seatd"
+        echo "  sudo zypper install -y libinput-devel libpixman-1-0-devel libpng16-devel freetype2-devel fontconfig-devel seatd"
         echo "  sudo zypper install -y Mesa-libEGL-devel Mesa-libgbm-devel libdrm-devel"
         ;;
     void)
         echo "Install dependencies (Void Linux):"
         echo "  sudo xbps-install -Syu base-devel pkg-config"
         echo "  sudo xbps-install -y wlroots-devel wayland-devel wayland-protocols"
-        echo "  sudo xbps-install -y libxkbcommon-devel libinput-devel pixman-devel"
+        echo "  sudo xbps-install -y libxkbcommon-devel libinput-devel pixman-devel libpng-devel freetype-devel fontconfig-devel"
         echo "  sudo xbps-install -y mesa-devel seatd seatd-devel"
         ;;
     *)
         echo "Please install: wlroots, wayland, wayland-protocols, libxkbcommon,"
-        echo "libinput, pixman, mesa/libdrm/gbm, and seatd manually"
+        echo "libinput, pixman, libpng, freetype2, fontconfig, mesa/libdrm/gbm, and seatd manually"
         ;;
 esac
 
@@ -84,7 +84,7 @@ fi
 
 # Try to find the right wlroots version
 WLROOTS_PKG=""
-for ver in wlroots-0.18 wlroots-0.17 wlroots; do
+for ver in wlroots-0.19 wlroots-0.18 wlroots-0.17 wlroots; do
     if pkg-config --exists "$ver" 2>/dev/null; then
         WLROOTS_PKG="$ver"
         echo "Found: $ver ($(pkg-config --modversion $ver))"
@@ -98,7 +98,7 @@ if [ -z "$WLROOTS_PKG" ]; then
 fi
 
 echo "Checking dependencies..."
-for lib in "$WLROOTS_PKG" wayland-server xkbcommon libinput pixman-1; do
+for lib in "$WLROOTS_PKG" wayland-server xkbcommon libinput pixman-1 libpng freetype2 fontconfig; do
     if ! pkg-config --exists "$lib" 2>/dev/null; then
         echo "Error: $lib not found"
         exit 1
@@ -134,18 +134,37 @@ else
     echo "✓ Protocol headers already exist"
 fi
 
+if [ ! -f xdg-shell-client-protocol.h ]; then
+    wayland-scanner client-header \
+        "$PROTO_DIR/stable/xdg-shell/xdg-shell.xml" \
+        xdg-shell-client-protocol.h
+    echo "✓ Generated xdg-shell-client-protocol.h"
+fi
+
 echo ""
 echo "=== Building ElDinWM ==="
 
-gcc -std=c11 -O2 -o eldinwm eldinwm.c xdg-shell-protocol.c \
+# The keymap cache is keyed on xkeyboard-config's files, so find where they live
+XKB_ROOT=$(pkg-config --variable=xkb_base xkeyboard-config 2>/dev/null)
+XKB_ROOT=${XKB_ROOT:-/usr/share/X11/xkb}
+
+# Trace verbosity is fixed at compile time: TRACE_LEVEL=TRACE_DEBUG ./build.sh
+gcc -std=c11 -O2 -pthread -o eldinwm eldinwm.c xdg-shell-protocol.c \
     -I. \
-    $(pkg-config --cflags --libs "$WLROOTS_PKG" wayland-server xkbcommon libinput pixman-1) \
-    -DWLR_USE_UNSTABLE
+    $(pkg-config --cflags --libs "$WLROOTS_PKG" wayland-server xkbcommon libinput pixman-1 libpng freetype2 fontconfig) \
+    -DWLR_USE_UNSTABLE -DTRACE_LEVEL="${TRACE_LEVEL:-TRACE_INFO}" \
+    -DXKB_CONFIG_ROOT="\"$XKB_ROOT\""
+
+gcc -std=c11 -O2 -o eldinwm-trace eldinwm-trace.c -I.
+gcc -std=c11 -O2 -o eldinwm-msg eldinwm-msg.c -I.
 
 if [ $? -eq 0 ]; then
     echo ""
     echo "=== Build Successful ==="
     echo "Binary: ./eldinwm"
+    echo "Trace decoder: ./eldinwm-trace [-f] [\$XDG_RUNTIME_DIR/eldinwm.trace]"
+    echo "Input recording: ELDINWM_RECORD=input.rec ./eldinwm, then ./eldinwm-trace -r input.rec"
+    echo "IPC client: ./eldinwm-msg workspace 2 | -m focus view | -S"
     echo ""
     echo "Create config at: ~/.config/eldinwm/eldinwm.conf"
     echo "To run: ./eldinwm"
@@ -154,3 +173,19 @@ else
     echo "Build failed"
     exit 1
 fi
+
+echo ""
+echo "=== Building Benchmark ==="
+
+if pkg-config --exists wayland-client 2>/dev/null; then
+    gcc -std=c11 -O2 -o eldinwm-bench eldinwm-bench.c xdg-shell-protocol.c \
+        -I. \
+        $(pkg-config --cflags --libs wayland-client)
+    echo "Binary: ./eldinwm-bench"
+    echo "To run: ./eldinwm-bench -n 16 -t 10 > bench.json"
+    echo "Startup budget: ./eldinwm-bench -S 20 -b 50"
+    echo "Layout engine: ./eldinwm-bench -L"
+    echo "Replay a recording: ./eldinwm-bench -P input.rec [-x 0]"
+else
+    echo "Skipped: wayland-client not found"
+fi
@@ -0,0 +1,836 @@
+/*
+ * ElDinWM - Headless stress and latency benchmark
+ *
+ * Starts eldinwm on the wlroots headless backend, connects N synthetic
+ * xdg-shell clients (shm buffers) and prints one JSON object with latency
+ * percentiles, commit throughput and the compositor's peak RSS.
+ *
+ * With -S it only measures startup instead: time to a usable socket over
+ * several runs, failing if it misses the budget (-b, milliseconds).
+ *
+ * With -L it runs no compositor at all and times the layout engine alone,
+ * incremental against full relayout, as views come and go.
+ *
+ * With -P the compositor replays an input recording (ELDINWM_RECORD) on
+ * the headless backend while the clients run, and its per-event latency
+ * report is printed instead; -x sets the speed (0 = as fast as possible).
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <time.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include <wayland-client.h>
+#include "xdg-shell-client-protocol.h"
+#include "eldinwm-layout.h"
+
+#define MAX_CLIENTS 256
+#define POOL_W 3840
+#define POOL_H 2160
+#define DEFAULT_W 640
+#define DEFAULT_H 480
+#define NSEC_PER_MSEC 1000000LL
+#define NSEC_PER_SEC 1000000000LL
+#define LAYOUT_BENCH_W 3840
+#define LAYOUT_BENCH_H 2160
+#define LAYOUT_BENCH_ITERS 2000
+
+/* Latency samples in nanoseconds */
+struct samples {
+    int64_t *v;
+    int n, cap;
+};
+
+struct client {
+    int id;
+    struct wl_display *display;
+    struct wl_compositor *compositor;
+    struct wl_shm *shm;
+    struct xdg_wm_base *wm_base;
+    struct wl_surface *surface;
+    struct xdg_surface *xdg_surface;
+    struct xdg_toplevel *toplevel;
+
+    struct wl_shm_pool *pool;
+    uint32_t *pixels;
+    struct wl_buffer *buffer;
+    int buf_w, buf_h;
+
+    int width, height;          /* last configured size, 0 = client's choice */
+    int pending_w, pending_h;
+    bool shrunk;                /* synthetic resize toggle */
+    bool mapped;
+    bool sized;                 /* got a non-zero configure after mapping */
+    bool presented;             /* got its first frame callback */
+    bool frame_pending;
+    int64_t map_ns;
+    int64_t next_commit_ns;
+    int64_t next_resize_ns;
+    uint64_t commits;
+    uint64_t frames;
+};
+
+static struct {
+    int nclients;
+    int duration_s;
+    int commit_hz;
+    int resize_hz;
+    int switches;
+    int startup_runs;           /* -S: startup mode, 0 = off */
+    int budget_ms;
+    bool layout;                /* -L: layout microbenchmark */
+    const char *replay;         /* -P: recording to replay */
+    const char *replay_speed;
+    const char *compositor;
+    bool verbose;
+
+    struct client clients[MAX_CLIENTS];
+    struct samples map_to_configure;
+    struct samples map_to_frame;
+    struct samples switch_lat;
+    struct samples key_bound, key_miss, key_plain;
+
+    pid_t pid;
+    int out_fd;
+    char line[1 << 20];
+    size_t line_len;
+} bench;
+
+static int64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static void samples_add(struct samples *s, int64_t v) {
+    if (s->n == s->cap) {
+        s->cap = s->cap ? s->cap * 2 : 64;
+        s->v = realloc(s->v, s->cap * sizeof(*s->v));
+        if (!s->v) {
+            fprintf(stderr, "Out of memory\n");
+            exit(1);
+        }
+    }
+    s->v[s->n++] = v;
+}
+
+static int cmp_i64(const void *a, const void *b) {
+    int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static double samples_pct(struct samples *s, double pct, double unit_ns) {
+    int idx = (int)(pct / 100.0 * (s->n - 1) + 0.5);
+    return s->v[idx] / unit_ns;
+}
+
+/* "name":{"count":..,"p50":..}, scaled from nanoseconds by unit_ns */
+static void samples_print(FILE *f, const char *name, struct samples *s, double unit_ns) {
+    fprintf(f, "\"%s\":{\"count\":%d", name, s->n);
+    if (s->n > 0) {
+        qsort(s->v, s->n, sizeof(*s->v), cmp_i64);
+        fprintf(f, ",\"p50\":%.1f,\"p90\":%.1f,\"p99\":%.1f,\"max\":%.1f",
+            samples_pct(s, 50, unit_ns), samples_pct(s, 90, unit_ns),
+            samples_pct(s, 99, unit_ns), s->v[s->n - 1] / unit_ns);
+    }
+    fprintf(f, "}");
+}
+
+/* Client side */
+
+static void buffer_release(void *data, struct wl_buffer *buffer) {
+}
+
+static const struct wl_buffer_listener buffer_listener = {
+    .release = buffer_release,
+};
+
+static void frame_done(void *data, struct wl_callback *cb, uint32_t time) {
+    struct client *c = data;
+    wl_callback_destroy(cb);
+    c->frame_pending = false;
+    c->frames++;
+    if (!c->presented) {
+        c->presented = true;
+        samples_add(&bench.map_to_frame, now_ns() - c->map_ns);
+    }
+}
+
+static const struct wl_callback_listener frame_listener = {
+    .done = frame_done,
+};
+
+static void client_commit(struct client *c, int64_t now) {
+    int w = c->width > 0 ? c->width : DEFAULT_W;
+    int h = c->height > 0 ? c->height : DEFAULT_H;
+    if (c->shrunk) {
+        w = w * 3 / 4;
+        h = h * 3 / 4;
+    }
+    if (w > POOL_W) w = POOL_W;
+    if (h > POOL_H) h = POOL_H;
+    if (w < 1) w = 1;
+    if (h < 1) h = 1;
+
+    if (!c->buffer || c->buf_w != w || c->buf_h != h) {
+        if (c->buffer) wl_buffer_destroy(c->buffer);
+        c->buffer = wl_shm_pool_create_buffer(c->pool, 0, w, h, w * 4,
+            WL_SHM_FORMAT_XRGB8888);
+        wl_buffer_add_listener(c->buffer, &buffer_listener, c);
+        c->buf_w = w;
+        c->buf_h = h;
+    }
+
+    /* Touch one row so every commit carries real damage */
+    int row = (int)(c->commits % h);
+    memset(&c->pixels[row * w], (int)(c->commits & 0xff), w * 4);
+
+    wl_surface_attach(c->surface, c->buffer, 0, 0);
+    wl_surface_damage_buffer(c->surface, 0, row, w, 1);
+    if (!c->frame_pending) {
+        struct wl_callback *cb = wl_surface_frame(c->surface);
+        wl_callback_add_listener(cb, &frame_listener, c);
+        c->frame_pending = true;
+    }
+    wl_surface_commit(c->surface);
+    c->commits++;
+
+    if (!c->mapped) {
+        c->mapped = true;
+        c->map_ns = now;
+    }
+}
+
+static void xdg_surface_configure(void *data, struct xdg_surface *xdg_surface, uint32_t serial) {
+    struct client *c = data;
+    xdg_surface_ack_configure(xdg_surface, serial);
+
+    int64_t now = now_ns();
+    c->width = c->pending_w;
+    c->height = c->pending_h;
+
+    if (!c->mapped) {
+        client_commit(c, now);
+    } else if (!c->sized && c->width > 0) {
+        c->sized = true;
+        samples_add(&bench.map_to_configure, now - c->map_ns);
+    }
+}
+
+static const struct xdg_surface_listener xdg_surface_listener = {
+    .configure = xdg_surface_configure,
+};
+
+static void toplevel_configure(void *data, struct xdg_toplevel *toplevel,
+        int32_t width, int32_t height, struct wl_array *states) {
+    struct client *c = data;
+    c->pending_w = width;
+    c->pending_h = height;
+}
+
+static void toplevel_close(void *data, struct xdg_toplevel *toplevel) {
+}
+
+static void toplevel_configure_bounds(void *data, struct xdg_toplevel *toplevel,
+        int32_t width, int32_t height) {
+}
+
+static void toplevel_wm_capabilities(void *data, struct xdg_toplevel *toplevel,
+        struct wl_array *caps) {
+}
+
+static const struct xdg_toplevel_listener toplevel_listener = {
+    .configure = toplevel_configure,
+    .close = toplevel_close,
+    .configure_bounds = toplevel_configure_bounds,
+    .wm_capabilities = toplevel_wm_capabilities,
+};
+
+static void wm_base_ping(void *data, struct xdg_wm_base *wm_base, uint32_t serial) {
+    xdg_wm_base_pong(wm_base, serial);
+}
+
+static const struct xdg_wm_base_listener wm_base_listener = {
+    .ping = wm_base_ping,
+};
+
+static void registry_global(void *data, struct wl_registry *registry,
+        uint32_t name, const char *interface, uint32_t version) {
+    struct client *c = data;
+    if (strcmp(interface, "wl_compositor") == 0) {
+        c->compositor = wl_registry_bind(registry, name, &wl_compositor_interface, 4);
+    } else if (strcmp(interface, "wl_shm") == 0) {
+        c->shm = wl_registry_bind(registry, name, &wl_shm_interface, 1);
+    } else if (strcmp(interface, "xdg_wm_base") == 0) {
+        c->wm_base = wl_registry_bind(registry, name, &xdg_wm_base_interface, 1);
+        xdg_wm_base_add_listener(c->wm_base, &wm_base_listener, c);
+    }
+}
+
+static void registry_global_remove(void *data, struct wl_registry *registry, uint32_t name) {
+}
+
+static const struct wl_registry_listener registry_listener = {
+    .global = registry_global,
+    .global_remove = registry_global_remove,
+};
+
+static bool client_connect(struct client *c, const char *socket) {
+    c->display = wl_display_connect(socket);
+    if (!c->display) return false;
+
+    struct wl_registry *registry = wl_display_get_registry(c->display);
+    wl_registry_add_listener(registry, &registry_listener, c);
+    wl_display_roundtrip(c->display);
+    if (!c->compositor || !c->shm || !c->wm_base) return false;
+
+    /* Sparse memfd: pages are only committed as rows get touched */
+    size_t size = (size_t)POOL_W * POOL_H * 4;
+    int fd = memfd_create("eldinwm-bench", MFD_CLOEXEC);
+    if (fd < 0 || ftruncate(fd, size) < 0) return false;
+    c->pixels = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (c->pixels == MAP_FAILED) return false;
+    c->pool = wl_shm_create_pool(c->shm, fd, (int32_t)size);
+    close(fd);
+
+    c->surface = wl_compositor_create_surface(c->compositor);
+    c->xdg_surface = xdg_wm_base_get_xdg_surface(c->wm_base, c->surface);
+    xdg_surface_add_listener(c->xdg_surface, &xdg_surface_listener, c);
+    c->toplevel = xdg_surface_get_toplevel(c->xdg_surface);
+    xdg_toplevel_add_listener(c->toplevel, &toplevel_listener, c);
+
+    char title[32];
+    snprintf(title, sizeof(title), "bench-%d", c->id);
+    xdg_toplevel_set_title(c->toplevel, title);
+    xdg_toplevel_set_app_id(c->toplevel, "eldinwm-bench");
+    wl_surface_commit(c->surface);
+    wl_display_flush(c->display);
+    return true;
+}
+
+/* Compositor side */
+
+static pid_t spawn_compositor(int *out_fd) {
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) < 0) return -1;
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        char switches[16];
+        snprintf(switches, sizeof(switches), "%d", bench.switches);
+        setenv("ELDINWM_BENCH", switches, 1);
+        setenv("WLR_BACKENDS", "headless", 1);
+        setenv("WLR_RENDERER", "pixman", 0);
+        setenv("WLR_HEADLESS_OUTPUTS", "1", 0);
+        if (bench.replay) {
+            setenv("ELDINWM_REPLAY", bench.replay, 1);
+            setenv("ELDINWM_REPLAY_SPEED", bench.replay_speed, 1);
+        }
+
+        dup2(fds[1], STDOUT_FILENO);
+        if (!bench.verbose) {
+            int null = open("/dev/null", O_WRONLY);
+            if (null >= 0) dup2(null, STDERR_FILENO);
+        }
+        execl(bench.compositor, bench.compositor, NULL);
+        _exit(127);
+    }
+
+    close(fds[1]);
+    *out_fd = fds[0];
+    return pid;
+}
+
+/* Read one JSON line from the compositor, or NULL if none is complete yet */
+static char *compositor_read_line(bool block) {
+    for (;;) {
+        char *nl = memchr(bench.line, '\n', bench.line_len);
+        if (nl) {
+            static char out[sizeof(bench.line)];
+            size_t len = nl - bench.line;
+            memcpy(out, bench.line, len);
+            out[len] = '\0';
+            bench.line_len -= len + 1;
+            memmove(bench.line, nl + 1, bench.line_len);
+            return out;
+        }
+
+        struct pollfd pfd = { .fd = bench.out_fd, .events = POLLIN };
+        if (poll(&pfd, 1, block ? 5000 : 0) <= 0) return NULL;
+        if (bench.line_len == sizeof(bench.line)) bench.line_len = 0;
+        ssize_t n = read(bench.out_fd, bench.line + bench.line_len,
+            sizeof(bench.line) - bench.line_len);
+        if (n <= 0) return NULL;
+        bench.line_len += n;
+    }
+}
+
+/* Add the numbers of the array "name":[...] in line to s */
+static void parse_array(const char *line, const char *name, struct samples *s) {
+    char tag[64];
+    snprintf(tag, sizeof(tag), "\"%s\":[", name);
+    const char *p = strstr(line, tag);
+    if (!p) return;
+    p += strlen(tag);
+    while (*p && *p != ']') {
+        char *end;
+        long long v = strtoll(p, &end, 10);
+        if (end == p) break;
+        samples_add(s, v);
+        p = (*end == ',') ? end + 1 : end;
+    }
+}
+
+/* The storm reports a switch line, then a key dispatch line; true once both are in */
+static bool parse_storm_line(const char *line) {
+    if (strstr(line, "\"event\":\"switch\"")) {
+        parse_array(line, "ns", &bench.switch_lat);
+    } else if (strstr(line, "\"event\":\"keys\"")) {
+        parse_array(line, "bound_ns", &bench.key_bound);
+        parse_array(line, "miss_ns", &bench.key_miss);
+        parse_array(line, "plain_ns", &bench.key_plain);
+        return true;
+    }
+    return false;
+}
+
+/* Add the number after "name": in line to s, scaled to nanoseconds */
+static void parse_value(const char *line, const char *name, int64_t unit_ns,
+        struct samples *s) {
+    char tag[64];
+    snprintf(tag, sizeof(tag), "\"%s\":", name);
+    const char *p = strstr(line, tag);
+    if (p) samples_add(s, strtoll(p + strlen(tag), NULL, 10) * unit_ns);
+}
+
+static long peak_rss_kb(pid_t pid) {
+    char path[64], buf[256];
+    snprintf(path, sizeof(path), "/proc/%d/status", (int)pid);
+    FILE *f = fopen(path, "r");
+    if (!f) return -1;
+    long kb = -1;
+    while (fgets(buf, sizeof(buf), f)) {
+        if (sscanf(buf, "VmHWM: %ld", &kb) == 1) break;
+    }
+    fclose(f);
+    return kb;
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr, "Usage: %s [-n clients] [-t seconds] [-r commit_hz] "
+        "[-R resize_hz] [-s switches] [-c compositor] [-v]\n"
+        "       %s -S runs [-b budget_ms] [-c compositor] [-v]\n"
+        "       %s -P recording [-x speed] [-n clients] [-r commit_hz] [-c compositor] [-v]\n"
+        "       %s -L\n", argv0, argv0, argv0, argv0);
+}
+
+/* Ready is timed from fork to the compositor's ready line, sent once the
+ * socket listens and the backend has started; that is what a session
+ * waits for. The phases come from the compositor, counted from main().
+ * Passes if the 90th percentile of ready is within the budget. */
+static int bench_startup(void) {
+    struct samples ready = {0}, socket = {0}, first_frame = {0}, deferred = {0};
+    for (int i = 0; i < bench.startup_runs; i++) {
+        bench.line_len = 0;
+        int64_t start = now_ns();
+        bench.pid = spawn_compositor(&bench.out_fd);
+        if (bench.pid < 0) {
+            fprintf(stderr, "Failed to start %s\n", bench.compositor);
+            return 1;
+        }
+
+        char *line = compositor_read_line(true);
+        if (!line || !strstr(line, "\"event\":\"ready\"")) {
+            fprintf(stderr, "Compositor did not report ready\n");
+            kill(bench.pid, SIGTERM);
+            return 1;
+        }
+        samples_add(&ready, now_ns() - start);
+
+        while ((line = compositor_read_line(true)) && !strstr(line, "\"event\":\"startup\"")) {
+        }
+        if (line) {
+            parse_value(line, "socket", 1000, &socket);
+            parse_value(line, "first_frame", 1000, &first_frame);
+            parse_value(line, "deferred", 1000, &deferred);
+        }
+
+        kill(bench.pid, SIGTERM);
+        waitpid(bench.pid, NULL, 0);
+        close(bench.out_fd);
+    }
+
+    qsort(ready.v, ready.n, sizeof(*ready.v), cmp_i64);
+    double p90_ms = samples_pct(&ready, 90, NSEC_PER_MSEC);
+    bool ok = p90_ms <= bench.budget_ms;
+
+    printf("{\"runs\":%d,\"budget_ms\":%d,", bench.startup_runs, bench.budget_ms);
+    samples_print(stdout, "ready_us", &ready, 1000.0);
+    printf(",");
+    samples_print(stdout, "socket_us", &socket, 1000.0);
+    printf(",");
+    samples_print(stdout, "first_frame_us", &first_frame, 1000.0);
+    printf(",");
+    samples_print(stdout, "deferred_us", &deferred, 1000.0);
+    printf(",\"ok\":%s}\n", ok ? "true" : "false");
+    if (!ok) {
+        fprintf(stderr, "Startup over budget: p90 %.1f ms > %d ms\n", p90_ms, bench.budget_ms);
+    }
+    return ok ? 0 : 1;
+}
+
+/* One workspace as the compositor keeps it: ids packed in layout order,
+ * and how far down they changed since the last layout */
+struct layout_ws {
+    enum layout layout;
+    int ids[MAX_CLIENTS];
+    int count, laid, shift, added;
+    struct layout_rect rects[MAX_CLIENTS];      /* by id, as last applied */
+    bool placed[MAX_CLIENTS];
+};
+
+enum layout_op {
+    OP_APPEND,
+    OP_REMOVE_FIRST,
+    OP_REMOVE_MIDDLE,
+    OP_REMOVE_LAST,
+    OP_COUNT
+};
+
+static const char *const layout_op_names[] = {
+    [OP_APPEND] = "append",
+    [OP_REMOVE_FIRST] = "remove-first",
+    [OP_REMOVE_MIDDLE] = "remove-middle",
+    [OP_REMOVE_LAST] = "remove-last",
+};
+
+static void layout_ws_take(struct layout_ws *w, int id) {
+    if (w->count < w->shift) w->shift = w->count;
+    w->ids[w->count++] = id;
+    w->added++;
+}
+
+static int layout_ws_release(struct layout_ws *w, int slot) {
+    int id = w->ids[slot];
+    int count = --w->count;
+    if (slot > count - w->added) w->added--;
+    memmove(&w->ids[slot], &w->ids[slot + 1], (count - slot) * sizeof(w->ids[0]));
+    if (slot < w->shift) w->shift = slot;
+    w->placed[id] = false;
+    return id;
+}
+
+/* As layout_workspace() does it, or from slot 0 like the old engine.
+ * Returns the slots computed; *changed counts rects that really moved. */
+static int layout_ws_apply(struct layout_ws *w, bool full, int *changed) {
+    int first = full ? 0 : layout_first_changed(w->layout, w->laid, w->count, w->shift, w->added);
+    *changed = 0;
+    for (int slot = first; slot < w->count; slot++) {
+        int id = w->ids[slot];
+        struct layout_rect r = layout_rect(w->layout, slot, w->count,
+            LAYOUT_BENCH_W, LAYOUT_BENCH_H);
+        if (!w->placed[id] || memcmp(&r, &w->rects[id], sizeof(r)) != 0) {
+            w->rects[id] = r;
+            w->placed[id] = true;
+            (*changed)++;
+        }
+    }
+    w->laid = w->count;
+    w->shift = MAX_CLIENTS;
+    w->added = 0;
+    return w->count - first;
+}
+
+/* Every view where a full layout would put it */
+static bool layout_ws_check(const struct layout_ws *w) {
+    for (int slot = 0; slot < w->count; slot++) {
+        int id = w->ids[slot];
+        struct layout_rect r = layout_rect(w->layout, slot, w->count,
+            LAYOUT_BENCH_W, LAYOUT_BENCH_H);
+        if (!w->placed[id] || memcmp(&r, &w->rects[id], sizeof(r)) != 0) return false;
+    }
+    return true;
+}
+
+/* Each op is timed on a workspace of n views (n - 1 before an append) and
+ * undone untimed. "computed" against "changed" shows how close the engine
+ * gets to touching only what moved; passes if every incremental layout
+ * ends where a full one would. */
+static int bench_layout(void) {
+    static const char *const names[] = {
+#define X(layout, name) [layout] = name,
+        LAYOUTS(X)
+#undef X
+    };
+    static const int sizes[] = { 16, 64, 256 };
+    static struct layout_ws w;
+    bool ok = true;
+
+    printf("{\"layout\":[");
+    for (int l = 0; l < LAYOUT_COUNT; l++) {
+        for (size_t n_i = 0; n_i < sizeof(sizes) / sizeof(sizes[0]); n_i++) {
+            int n = sizes[n_i];
+            for (int op = 0; op < OP_COUNT; op++) {
+                memset(&w, 0, sizeof(w));
+                w.layout = (enum layout)l;
+                w.shift = MAX_CLIENTS;
+                int changed, spare = n - 1;
+                for (int id = 0; id < (op == OP_APPEND ? n - 1 : n); id++) {
+                    layout_ws_take(&w, id);
+                }
+                layout_ws_apply(&w, false, &changed);
+
+                struct samples incremental = {0}, full = {0};
+                int computed = 0, moved = 0;
+                for (int i = 0; i < LAYOUT_BENCH_ITERS * 2; i++) {
+                    bool is_full = i & 1;
+                    int slot = op == OP_REMOVE_FIRST ? 0 :
+                        op == OP_REMOVE_MIDDLE ? w.count / 2 : w.count - 1;
+                    int64_t start = now_ns();
+                    int id = -1;
+                    if (op == OP_APPEND) {
+                        layout_ws_take(&w, spare);
+                    } else {
+                        id = layout_ws_release(&w, slot);
+                    }
+                    int c = layout_ws_apply(&w, is_full, &changed);
+                    samples_add(is_full ? &full : &incremental, now_ns() - start);
+                    if (!layout_ws_check(&w)) ok = false;
+                    if (!is_full) {
+                        computed = c;
+                        moved = changed;
+                    }
+
+                    if (op == OP_APPEND) {
+                        spare = layout_ws_release(&w, w.count - 1);
+                    } else {
+                        layout_ws_take(&w, id);
+                    }
+                    layout_ws_apply(&w, false, &changed);
+                }
+
+                printf("%s{\"name\":\"%s\",\"views\":%d,\"op\":\"%s\","
+                    "\"computed\":%d,\"changed\":%d,",
+                    l || n_i || op ? "," : "", names[l], n, layout_op_names[op],
+                    computed, moved);
+                samples_print(stdout, "incremental_ns", &incremental, 1.0);
+                printf(",");
+                samples_print(stdout, "full_ns", &full, 1.0);
+                printf("}");
+                free(incremental.v);
+                free(full.v);
+            }
+        }
+    }
+    printf("],\"ok\":%s}\n", ok ? "true" : "false");
+    if (!ok) fprintf(stderr, "Incremental layout disagrees with a full one\n");
+    return ok ? 0 : 1;
+}
+
+int main(int argc, char *argv[]) {
+    bench.nclients = 8;
+    bench.duration_s = 5;
+    bench.commit_hz = 60;
+    bench.resize_hz = 0;
+    bench.switches = 200;
+    bench.budget_ms = 50;
+    bench.compositor = "./eldinwm";
+    bench.replay_speed = "1";
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:t:r:R:s:S:b:c:LP:x:vh")) != -1) {
+        switch (opt) {
+            case 'n': bench.nclients = atoi(optarg); break;
+            case 't': bench.duration_s = atoi(optarg); break;
+            case 'r': bench.commit_hz = atoi(optarg); break;
+            case 'R': bench.resize_hz = atoi(optarg); break;
+            case 's': bench.switches = atoi(optarg); break;
+            case 'S': bench.startup_runs = atoi(optarg); break;
+            case 'b': bench.budget_ms = atoi(optarg); break;
+            case 'c': bench.compositor = optarg; break;
+            case 'L': bench.layout = true; break;
+            case 'P': bench.replay = optarg; break;
+            case 'x': bench.replay_speed = optarg; break;
+            case 'v': bench.verbose = true; break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    if (bench.nclients < 1 || bench.nclients > MAX_CLIENTS ||
+            bench.duration_s < 1 || bench.commit_hz < 1 || bench.switches < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (bench.startup_runs > 0) return bench_startup();
+    if (bench.layout) return bench_layout();
+
+    bench.pid = spawn_compositor(&bench.out_fd);
+    if (bench.pid < 0) {
+        fprintf(stderr, "Failed to start %s\n", bench.compositor);
+        return 1;
+    }
+
+    char socket[64] = {0};
+    char *line = compositor_read_line(true);
+    const char *p = line ? strstr(line, "\"socket\":\"") : NULL;
+    if (!p || sscanf(p, "\"socket\":\"%63[^\"]", socket) != 1) {
+        fprintf(stderr, "Compositor did not report ready\n");
+        kill(bench.pid, SIGTERM);
+        return 1;
+    }
+
+    for (int i = 0; i < bench.nclients; i++) {
+        struct client *c = &bench.clients[i];
+        c->id = i;
+        if (!client_connect(c, socket)) {
+            fprintf(stderr, "Client %d failed to connect\n", i);
+            kill(bench.pid, SIGTERM);
+            return 1;
+        }
+    }
+
+    int64_t commit_period = NSEC_PER_SEC / bench.commit_hz;
+    int64_t resize_period = bench.resize_hz > 0 ? NSEC_PER_SEC / bench.resize_hz : 0;
+    int64_t start = now_ns();
+    int64_t end = start + bench.duration_s * NSEC_PER_SEC;
+    int64_t storm_at = start + (end - start) / 2;
+    bool storm_sent = false;
+    bool storm_done = false;
+    char *replay_report = NULL;
+
+    /* A replay runs until the compositor reports it done; no storm */
+    if (bench.replay) {
+        end = INT64_MAX;
+        storm_sent = storm_done = true;
+    }
+    struct pollfd pfds[MAX_CLIENTS];
+
+    for (int i = 0; i < bench.nclients; i++) {
+        bench.clients[i].next_commit_ns = start + commit_period;
+        bench.clients[i].next_resize_ns = resize_period ? start + resize_period : INT64_MAX;
+    }
+
+    for (int64_t now = start; now < end; now = now_ns()) {
+        /* Drive commits and synthetic resizes */
+        int64_t wake = bench.replay ? now + 10 * NSEC_PER_MSEC : end;
+        for (int i = 0; i < bench.nclients; i++) {
+            struct client *c = &bench.clients[i];
+            if (now >= c->next_resize_ns) {
+                c->shrunk = !c->shrunk;
+                c->next_resize_ns += resize_period;
+            }
+            if (c->mapped && now >= c->next_commit_ns) {
+                client_commit(c, now);
+                c->next_commit_ns += commit_period;
+                if (c->next_commit_ns < now) c->next_commit_ns = now + commit_period;
+            }
+            if (c->next_commit_ns < wake) wake = c->next_commit_ns;
+        }
+
+        if (!storm_sent && now >= storm_at) {
+            kill(bench.pid, SIGUSR1);
+            storm_sent = true;
+        }
+        while (storm_sent && !storm_done && (line = compositor_read_line(false))) {
+            storm_done = parse_storm_line(line);
+        }
+        while (bench.replay && !replay_report && (line = compositor_read_line(false))) {
+            if (strstr(line, "\"event\":\"replay\"")) replay_report = strdup(line);
+        }
+        if (replay_report) break;
+
+        for (int i = 0; i < bench.nclients; i++) {
+            struct wl_display *d = bench.clients[i].display;
+            while (wl_display_prepare_read(d) != 0) {
+                wl_display_dispatch_pending(d);
+            }
+            wl_display_flush(d);
+            pfds[i].fd = wl_display_get_fd(d);
+            pfds[i].events = POLLIN;
+            pfds[i].revents = 0;
+        }
+
+        int timeout = (int)((wake - now) / NSEC_PER_MSEC);
+        if (timeout < 0) timeout = 0;
+        if (poll(pfds, bench.nclients, timeout) < 0) break;
+
+        for (int i = 0; i < bench.nclients; i++) {
+            struct wl_display *d = bench.clients[i].display;
+            if (pfds[i].revents & POLLIN) {
+                wl_display_read_events(d);
+            } else {
+                wl_display_cancel_read(d);
+            }
+            if (wl_display_dispatch_pending(d) < 0) {
+                if (bench.replay) {
+                    end = 0;            /* replay done, the report is on its way */
+                    break;
+                }
+                fprintf(stderr, "Client %d lost connection\n", i);
+                kill(bench.pid, SIGTERM);
+                return 1;
+            }
+        }
+    }
+    double elapsed = (now_ns() - start) / (double)NSEC_PER_SEC;
+
+    if (bench.replay) {
+        while (!replay_report && (line = compositor_read_line(true))) {
+            if (strstr(line, "\"event\":\"replay\"")) replay_report = strdup(line);
+        }
+        for (int i = 0; i < bench.nclients; i++) {
+            wl_display_disconnect(bench.clients[i].display);
+        }
+        kill(bench.pid, SIGTERM);
+        waitpid(bench.pid, NULL, 0);
+        if (!replay_report) {
+            fprintf(stderr, "Compositor did not finish the replay\n");
+            return 1;
+        }
+        printf("%s\n", replay_report);
+        free(replay_report);
+        return 0;
+    }
+
+    while (storm_sent && !storm_done && (line = compositor_read_line(true))) {
+        storm_done = parse_storm_line(line);
+    }
+
+    long rss = peak_rss_kb(bench.pid);
+    uint64_t commits = 0, frames = 0;
+    for (int i = 0; i < bench.nclients; i++) {
+        commits += bench.clients[i].commits;
+        frames += bench.clients[i].frames;
+        wl_display_disconnect(bench.clients[i].display);
+    }
+    kill(bench.pid, SIGTERM);
+    waitpid(bench.pid, NULL, 0);
+
+    printf("{\"clients\":%d,\"duration_s\":%.2f,\"commit_hz\":%d,\"resize_hz\":%d,",
+        bench.nclients, elapsed, bench.commit_hz, bench.resize_hz);
+    samples_print(stdout, "map_to_configure_us", &bench.map_to_configure, 1000.0);
+    printf(",");
+    samples_print(stdout, "map_to_frame_us", &bench.map_to_frame, 1000.0);
+    printf(",");
+    samples_print(stdout, "switch_us", &bench.switch_lat, 1000.0);
+    printf(",");
+    samples_print(stdout, "key_bound_ns", &bench.key_bound, 1.0);
+    printf(",");
+    samples_print(stdout, "key_miss_ns", &bench.key_miss, 1.0);
+    printf(",");
+    samples_print(stdout, "key_plain_ns", &bench.key_plain, 1.0);
+    printf(",\"commits\":%llu,\"commits_per_s\":%.1f,\"frames_done_per_s\":%.1f,"
+        "\"compositor_peak_rss_kb\":%ld}\n",
+        (unsigned long long)commits, commits / elapsed, frames / elapsed, rss);
+    return 0;
+}
@@ -0,0 +1,93 @@
+/*
+ * ElDinWM - IPC protocol and state snapshot
+ *
+ * Shared by the compositor and eldinwm-msg. Commands are text lines on a
+ * Unix stream socket; each one is answered with zero or more lines of
+ * output and then "ok" or "error <reason>". After "subscribe", matching
+ * events arrive as lines starting with "event ".
+ *
+ * The snapshot is a file in $XDG_RUNTIME_DIR mapped shared by the
+ * compositor, guarded by a seqlock so pollers read it without syscalls.
+ */
+
+#ifndef ELDINWM_IPC_H
+#define ELDINWM_IPC_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+/* Exported to clients started by the compositor */
+#define IPC_SOCKET_ENV "ELDINWM_SOCK"
+#define IPC_SNAPSHOT_ENV "ELDINWM_STATE"
+
+#define IPC_LINE_MAX 1024
+
+/* Event classes for "subscribe"; names are the words clients send */
+#define IPC_EVENTS(X) \
+    X(IPC_EVENT_WORKSPACE, "workspace") \
+    X(IPC_EVENT_FOCUS,     "focus") \
+    X(IPC_EVENT_VIEW,      "view")
+
+enum {
+#define X(ev, name) ev##_BIT,
+    IPC_EVENTS(X)
+#undef X
+};
+
+enum {
+#define X(ev, name) ev = 1u << ev##_BIT,
+    IPC_EVENTS(X)
+#undef X
+};
+
+#define IPC_SNAPSHOT_MAGIC "ELDSNP02"
+#define IPC_MAX_OUTPUTS 8
+#define IPC_MAX_WORKSPACES 16
+#define IPC_VIEWS_PER_WS 16         /* first views of each workspace, in layout order */
+#define IPC_NAME_LEN 32
+
+/* A view as the compositor names it in events and commands: "index:generation".
+ * Generation 0 never refers to a live view. */
+struct ipc_view {
+    uint32_t index;
+    uint32_t generation;
+    char app_id[IPC_NAME_LEN];
+};
+
+struct ipc_output {
+    char name[IPC_NAME_LEN];
+    int32_t current_ws;
+    uint32_t occupied;          /* bit per workspace with at least one view */
+    int32_t view_counts[IPC_MAX_WORKSPACES];    /* may exceed IPC_VIEWS_PER_WS */
+    struct ipc_view slots[IPC_MAX_WORKSPACES][IPC_VIEWS_PER_WS];
+};
+
+struct ipc_snapshot {
+    char magic[8];
+    uint32_t size;              /* sizeof(struct ipc_snapshot) */
+    _Atomic uint32_t seq;       /* odd while the compositor is writing */
+    int32_t workspaces;
+    int32_t output_count;
+    int32_t focused_output;     /* index into outputs[], -1 if none */
+    struct ipc_view focused;
+    struct ipc_output outputs[IPC_MAX_OUTPUTS];
+};
+
+/* Copy a consistent snapshot out of the mapping; false if the compositor
+ * kept writing for the whole attempt, which callers treat as "try later" */
+static inline bool ipc_snapshot_read(const struct ipc_snapshot *shared,
+        struct ipc_snapshot *out) {
+    _Atomic uint32_t *seq = (_Atomic uint32_t *)&shared->seq;
+    for (int attempt = 0; attempt < 1000; attempt++) {
+        uint32_t before = atomic_load_explicit(seq, memory_order_acquire);
+        if (before & 1) continue;
+        memcpy(out, (const void *)shared, sizeof(*out));
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(seq, memory_order_relaxed) == before) return true;
+    }
+    return false;
+}
+
+#endif
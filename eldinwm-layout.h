@@ -0,0 +1,105 @@
+/*
+ * ElDinWM - Tiling layouts
+ *
+ * Pure geometry, shared by the compositor and eldinwm-bench's layout
+ * microbenchmark. A workspace holds its views densely in layout order;
+ * a layout maps (index, count, area) to a rectangle.
+ *
+ * Relayout is incremental: after views are added or removed, only the
+ * indices from layout_first_changed() on get new rectangles. That range
+ * holds every view whose rectangle can differ and, short of rounding,
+ * nothing else: a grid only reflows behind the change, monocle only
+ * places new views, master/stack resizes its stack.
+ */
+
+#ifndef ELDINWM_LAYOUT_H
+#define ELDINWM_LAYOUT_H
+
+/* X(layout, name) - names are the words used in the config and bindings */
+#define LAYOUTS(X) \
+    X(LAYOUT_MASTER,  "master") \
+    X(LAYOUT_GRID,    "grid") \
+    X(LAYOUT_MONOCLE, "monocle")
+
+enum layout {
+#define X(layout, name) layout,
+    LAYOUTS(X)
+#undef X
+    LAYOUT_COUNT
+};
+
+struct layout_rect {
+    int x, y, width, height;
+};
+
+/* Columns then rows, as square as possible */
+static inline void layout_grid_shape(int n, int *cols, int *rows) {
+    int c = 1;
+    while (c * c < n) c++;
+    *cols = c;
+    *rows = n > 0 ? (n + c - 1) / c : 0;
+}
+
+/* Splits [0, size) into parts without gaps; part i of count */
+static inline void layout_split(int size, int i, int count, int *pos, int *len) {
+    *pos = (int)((long long)size * i / count);
+    *len = (int)((long long)size * (i + 1) / count) - *pos;
+}
+
+/*
+ * master  - one view alone fills the area; otherwise the first takes the
+ *           left half and the rest stack on the right
+ * grid    - equal cells, row by row
+ * monocle - every view fills the area, the focused one on top
+ */
+static inline struct layout_rect layout_rect(enum layout layout, int i, int n,
+        int width, int height) {
+    struct layout_rect r = { 0, 0, width, height };
+    switch (layout) {
+        case LAYOUT_MASTER:
+            if (n < 2) break;
+            r.width = width / 2;
+            if (i == 0) break;
+            r.x = width / 2;
+            layout_split(height, i - 1, n - 1, &r.y, &r.height);
+            break;
+        case LAYOUT_GRID: {
+            int cols, rows;
+            layout_grid_shape(n, &cols, &rows);
+            layout_split(width, i % cols, cols, &r.x, &r.width);
+            layout_split(height, i / cols, rows, &r.y, &r.height);
+            break;
+        }
+        case LAYOUT_MONOCLE:
+        case LAYOUT_COUNT:
+            break;
+    }
+    return r;
+}
+
+/* First index whose rectangle can differ after the count went from old_n
+ * to n. Views from index shifted on moved up or are new; the last added
+ * of them were appended. Returns n if nothing needs recomputing. */
+static inline int layout_first_changed(enum layout layout, int old_n, int n,
+        int shifted, int added) {
+    int first = n - added;                          /* new views always need one */
+    switch (layout) {
+        case LAYOUT_MASTER:
+            if (old_n != n && (old_n < 2 || n < 2)) return 0;   /* the master changes width */
+            if (old_n != n && shifted > 1) shifted = 1;         /* every stack height changes */
+            break;
+        case LAYOUT_GRID: {
+            int old_cols, old_rows, cols, rows;
+            layout_grid_shape(old_n, &old_cols, &old_rows);
+            layout_grid_shape(n, &cols, &rows);
+            if (cols != old_cols || rows != old_rows) return 0;
+            break;
+        }
+        case LAYOUT_MONOCLE:
+        case LAYOUT_COUNT:
+            return first;                           /* every slot is the same */
+    }
+    return shifted < first ? shifted : first;
+}
+
+#endif
@@ -0,0 +1,135 @@
+/*
+ * ElDinWM - IPC client
+ *
+ * Sends one command to a running eldinwm and prints the reply. With -m it
+ * subscribes to events and prints them as they arrive; with -S it prints
+ * the shared-memory snapshot instead of using the socket at all.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "eldinwm-ipc.h"
+
+static int print_snapshot(const char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        fprintf(stderr, "Cannot open %s\n", path);
+        return 1;
+    }
+    const struct ipc_snapshot *shared = mmap(NULL, sizeof(*shared), PROT_READ,
+        MAP_SHARED, fd, 0);
+    close(fd);
+    if (shared == MAP_FAILED || memcmp(shared->magic, IPC_SNAPSHOT_MAGIC, 8) != 0 ||
+            shared->size != sizeof(*shared)) {
+        fprintf(stderr, "%s: not an eldinwm snapshot of this version\n", path);
+        return 1;
+    }
+
+    struct ipc_snapshot snap;
+    if (!ipc_snapshot_read(shared, &snap)) {
+        fprintf(stderr, "%s: compositor busy, try again\n", path);
+        return 1;
+    }
+
+    printf("focused %u:%u %s\n", snap.focused.index, snap.focused.generation,
+        snap.focused.app_id);
+    for (int i = 0; i < snap.output_count && i < IPC_MAX_OUTPUTS; i++) {
+        const struct ipc_output *o = &snap.outputs[i];
+        printf("output %s%s workspace %d\n", o->name,
+            i == snap.focused_output ? " (focused)" : "", o->current_ws + 1);
+        for (int ws = 0; ws < snap.workspaces && ws < IPC_MAX_WORKSPACES; ws++) {
+            if (!(o->occupied & (1u << ws))) continue;
+            printf("  %d:", ws + 1);
+            for (int slot = 0; slot < IPC_VIEWS_PER_WS; slot++) {
+                const struct ipc_view *v = &o->slots[ws][slot];
+                if (v->generation) printf(" %u:%u %s", v->index, v->generation, v->app_id);
+            }
+            if (o->view_counts[ws] > IPC_VIEWS_PER_WS) {
+                printf(" (+%d more)", o->view_counts[ws] - IPC_VIEWS_PER_WS);
+            }
+            printf("\n");
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    const char *path = NULL;
+    bool monitor = false, snapshot = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "s:mSh")) != -1) {
+        switch (opt) {
+            case 's': path = optarg; break;
+            case 'm': monitor = true; break;
+            case 'S': snapshot = true; break;
+            default:
+                fprintf(stderr, "Usage: %s [-s socket] command [args...]\n"
+                    "       %s [-s socket] -m workspace|focus|view...\n"
+                    "       %s -S\n", argv[0], argv[0], argv[0]);
+                return 1;
+        }
+    }
+
+    if (snapshot) {
+        const char *state = getenv(IPC_SNAPSHOT_ENV);
+        if (!state) {
+            fprintf(stderr, "%s is not set\n", IPC_SNAPSHOT_ENV);
+            return 1;
+        }
+        return print_snapshot(state);
+    }
+
+    if (!path) path = getenv(IPC_SOCKET_ENV);
+    if (!path || optind >= argc) {
+        fprintf(stderr, path ? "No command given\n" : "%s is not set\n", IPC_SOCKET_ENV);
+        return 1;
+    }
+
+    char line[IPC_LINE_MAX];
+    int len = snprintf(line, sizeof(line), "%s", monitor ? "subscribe" : "");
+    for (int i = optind; i < argc && len < (int)sizeof(line); i++) {
+        len += snprintf(line + len, sizeof(line) - len, "%s%s", len ? " " : "", argv[i]);
+    }
+    if (len >= (int)sizeof(line) - 1) {
+        fprintf(stderr, "Command too long\n");
+        return 1;
+    }
+    line[len++] = '\n';
+
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        fprintf(stderr, "Cannot connect to %s\n", path);
+        return 1;
+    }
+    if (write(fd, line, len) != len) {
+        fprintf(stderr, "Cannot send to %s\n", path);
+        return 1;
+    }
+
+    /* Print until the final status line; with -m, keep printing events */
+    FILE *in = fdopen(fd, "r");
+    while (fgets(line, sizeof(line), in)) {
+        if (strcmp(line, "ok\n") == 0) {
+            if (monitor) continue;
+            return 0;
+        }
+        if (strncmp(line, "error ", 6) == 0) {
+            fprintf(stderr, "%s", line + 6);
+            return 1;
+        }
+        fputs(line, stdout);
+        if (monitor) fflush(stdout);
+    }
+    return monitor ? 0 : 1;
+}
@@ -0,0 +1,64 @@
+/*
+ * ElDinWM - Input recording format
+ *
+ * Written by eldinwm with ELDINWM_RECORD, replayed by it with
+ * ELDINWM_REPLAY and printed by eldinwm-trace -r. A recording is a
+ * record_header followed by fixed-size input_records in time order.
+ */
+
+#ifndef ELDINWM_RECORD_H
+#define ELDINWM_RECORD_H
+
+#include <stdint.h>
+
+#define RECORD_MAGIC "ELDREC01"
+
+/* X(type, name) - append only: the position is the type stored in files.
+ *   key             code: state, value: keycode
+ *   motion          x, y: delta, ux, uy: unaccelerated delta
+ *   motion_absolute x, y: position, 0-1 across the layout
+ *   button          code: state, value: button
+ *   axis            code: orientation | source << 4 | direction << 8,
+ *                   value: discrete delta, x: delta
+ *   frame           end of a pointer event group
+ *   output          value: output id, x, y: mode size (enabled or changed)
+ *   output_removed  value: output id (unplugged or disabled)
+ *   view_mapped     value: view index
+ *   view_unmapped   value: view index */
+#define RECORD_TYPES(X) \
+    X(REC_KEY,             "key") \
+    X(REC_MOTION,          "motion") \
+    X(REC_MOTION_ABSOLUTE, "motion_absolute") \
+    X(REC_BUTTON,          "button") \
+    X(REC_AXIS,            "axis") \
+    X(REC_FRAME,           "frame") \
+    X(REC_OUTPUT,          "output") \
+    X(REC_OUTPUT_REMOVED,  "output_removed") \
+    X(REC_VIEW_MAPPED,     "view_mapped") \
+    X(REC_VIEW_UNMAPPED,   "view_unmapped")
+
+enum record_type {
+#define X(type, name) type,
+    RECORD_TYPES(X)
+#undef X
+    RECORD_TYPE_COUNT
+};
+
+struct record_header {
+    char magic[8];
+    uint32_t record_size;
+    uint32_t dropped;           /* records lost to a full ring, set on close */
+    int64_t realtime_start_ns;  /* CLOCK_REALTIME when recording started */
+};
+
+struct input_record {
+    uint64_t ts_ns;             /* since recording started */
+    uint16_t type;              /* enum record_type */
+    uint16_t code;
+    int32_t value;
+    float x, y, ux, uy;
+};
+
+_Static_assert(sizeof(struct input_record) == 32, "records are 32 bytes");
+
+#endif
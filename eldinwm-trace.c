@@ -0,0 +1,170 @@
+/*
+ * ElDinWM - Trace decoder
+ *
+ * Prints the binary trace written by eldinwm as text, one line per record.
+ * With -f it keeps following the file like tail -f. With -r it prints an
+ * input recording (ELDINWM_RECORD) instead.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "eldinwm-trace.h"
+#include "eldinwm-record.h"
+
+#define NSEC_PER_SEC 1000000000LL
+
+static const char *event_formats[] = {
+#define X(ev, level, fmt) [ev] = fmt,
+    TRACE_EVENTS(X)
+#undef X
+};
+
+static const char *level_names[] = {
+    [TRACE_ERROR] = "ERROR",
+    [TRACE_WARN] = "WARN",
+    [TRACE_INFO] = "INFO",
+    [TRACE_DEBUG] = "DEBUG",
+};
+
+static void print_record(const struct trace_record *rec, int64_t offset) {
+    int64_t wall = (int64_t)rec->ts_ns + offset;
+    time_t secs = (time_t)(wall / NSEC_PER_SEC);
+    struct tm tm;
+    localtime_r(&secs, &tm);
+
+    const char *level = rec->level <= TRACE_DEBUG ? level_names[rec->level] : "?";
+    printf("%02d:%02d:%02d.%06lld %-5s ", tm.tm_hour, tm.tm_min, tm.tm_sec,
+        (long long)(wall % NSEC_PER_SEC / 1000), level);
+
+    if (rec->event < TRACE_EVENT_COUNT) {
+        printf(event_formats[rec->event], (long long)rec->args[0],
+            (long long)rec->args[1], (long long)rec->args[2], (long long)rec->args[3]);
+    } else {
+        printf("unknown event %u (%lld %lld %lld %lld)", rec->event,
+            (long long)rec->args[0], (long long)rec->args[1],
+            (long long)rec->args[2], (long long)rec->args[3]);
+    }
+    printf("\n");
+}
+
+static const char *record_names[] = {
+#define X(type, name) [type] = name,
+    RECORD_TYPES(X)
+#undef X
+};
+
+/* Offset from the start of the recording, then the fields the type uses */
+static void print_input(const struct input_record *rec) {
+    printf("%6lld.%06lld ", (long long)(rec->ts_ns / NSEC_PER_SEC),
+        (long long)(rec->ts_ns % NSEC_PER_SEC / 1000));
+    if (rec->type >= RECORD_TYPE_COUNT) {
+        printf("unknown type %u\n", rec->type);
+        return;
+    }
+    printf("%-15s", record_names[rec->type]);
+    switch (rec->type) {
+        case REC_KEY: printf(" %d %s", rec->value, rec->code ? "pressed" : "released"); break;
+        case REC_BUTTON: printf(" 0x%x %s", rec->value, rec->code ? "pressed" : "released"); break;
+        case REC_MOTION: printf(" %+.2f %+.2f (unaccel %+.2f %+.2f)", rec->x, rec->y, rec->ux, rec->uy); break;
+        case REC_MOTION_ABSOLUTE: printf(" %.4f %.4f", rec->x, rec->y); break;
+        case REC_AXIS:
+            printf(" orientation %u source %u direction %u: %.2f (%d)", rec->code & 0xf,
+                (rec->code >> 4) & 0xf, rec->code >> 8, rec->x, rec->value);
+            break;
+        case REC_OUTPUT: printf(" %d %.0fx%.0f", rec->value, rec->x, rec->y); break;
+        case REC_OUTPUT_REMOVED:
+        case REC_VIEW_MAPPED:
+        case REC_VIEW_UNMAPPED: printf(" %d", rec->value); break;
+    }
+    printf("\n");
+}
+
+static int print_recording(FILE *f, const char *path) {
+    struct record_header header;
+    if (fread(&header, sizeof(header), 1, f) != 1 ||
+            memcmp(header.magic, RECORD_MAGIC, sizeof(header.magic)) != 0 ||
+            header.record_size != sizeof(struct input_record)) {
+        fprintf(stderr, "%s: not an eldinwm recording of this version\n", path);
+        return 1;
+    }
+    if (header.dropped) printf("# %u events dropped while recording\n", header.dropped);
+
+    struct input_record rec;
+    while (fread(&rec, sizeof(rec), 1, f) == 1) {
+        print_input(&rec);
+    }
+    fclose(f);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    bool follow = false, recording = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "frh")) != -1) {
+        switch (opt) {
+            case 'f': follow = true; break;
+            case 'r': recording = true; break;
+            default:
+                fprintf(stderr, "Usage: %s [-f] [trace-file]\n"
+                    "       %s -r recording\n", argv[0], argv[0]);
+                return 1;
+        }
+    }
+    if (recording && optind >= argc) {
+        fprintf(stderr, "No recording given\n");
+        return 1;
+    }
+
+    char path[512];
+    if (optind < argc) {
+        snprintf(path, sizeof(path), "%s", argv[optind]);
+    } else {
+        const char *runtime = getenv("XDG_RUNTIME_DIR");
+        snprintf(path, sizeof(path), "%s/eldinwm.trace", runtime ? runtime : "/tmp");
+    }
+
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        fprintf(stderr, "Cannot open %s\n", path);
+        return 1;
+    }
+    if (recording) return print_recording(f, path);
+
+    struct trace_header header;
+    if (fread(&header, sizeof(header), 1, f) != 1 ||
+            memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) != 0) {
+        fprintf(stderr, "%s: not an eldinwm trace\n", path);
+        return 1;
+    }
+    if (header.record_size != sizeof(struct trace_record)) {
+        fprintf(stderr, "%s: record size %u, expected %zu\n", path,
+            header.record_size, sizeof(struct trace_record));
+        return 1;
+    }
+
+    const struct timespec nap = { .tv_nsec = 100 * 1000 * 1000 };
+    struct trace_record rec;
+    for (;;) {
+        long pos = ftell(f);
+        if (fread(&rec, sizeof(rec), 1, f) == 1) {
+            print_record(&rec, header.realtime_offset_ns);
+            continue;
+        }
+        if (!follow) break;
+
+        /* Partial record: rewind and wait for the writer to finish it */
+        fflush(stdout);
+        clearerr(f);
+        fseek(f, pos, SEEK_SET);
+        nanosleep(&nap, NULL);
+    }
+
+    fclose(f);
+    return 0;
+}
@@ -0,0 +1,98 @@
+/*
+ * ElDinWM - Binary trace format
+ *
+ * Shared by the compositor (writer) and eldinwm-trace (decoder). A trace
+ * file is a trace_header followed by fixed-size trace_records.
+ */
+
+#ifndef ELDINWM_TRACE_H
+#define ELDINWM_TRACE_H
+
+#include <stdint.h>
+
+#define TRACE_MAGIC "ELDTRC01"
+
+enum trace_level {
+    TRACE_ERROR,
+    TRACE_WARN,
+    TRACE_INFO,
+    TRACE_DEBUG,
+};
+
+/* Events compiled in at or below this level; the rest cost nothing */
+#ifndef TRACE_LEVEL
+#define TRACE_LEVEL TRACE_INFO
+#endif
+
+/* X(event, level, format) - format takes up to four long long arguments.
+ * Append only: the position is the event id stored in trace files. */
+#define TRACE_EVENTS(X) \
+    X(EV_TRACE_DROPPED,   TRACE_WARN,  "trace: %lld records dropped, ring full") \
+    X(EV_OUTPUT_ADDED,    TRACE_INFO,  "output %lld added (%lld total)") \
+    X(EV_OUTPUT_REMOVED,  TRACE_INFO,  "output %lld removed (%lld frames, %lld skipped, %lld missed)") \
+    X(EV_DEADLINE_MISSED, TRACE_DEBUG, "output %lld missed vblank by %lld ns") \
+    X(EV_KEYBOARD_ADDED,  TRACE_INFO,  "keyboard added (%lld total)") \
+    X(EV_VIEW_MAPPED,     TRACE_INFO,  "view mapped to output %lld workspace %lld slot %lld") \
+    X(EV_VIEW_NO_SPACE,   TRACE_WARN,  "view mapped but all workspaces are full") \
+    X(EV_LAYOUT,          TRACE_DEBUG, "layout output %lld workspace %lld: %lld views") \
+    X(EV_WS_SWITCH,       TRACE_INFO,  "output %lld: workspace %lld -> %lld") \
+    X(EV_WS_BOUNDS,       TRACE_DEBUG, "output %lld: workspace %lld out of bounds") \
+    X(EV_FOCUS_CYCLED,    TRACE_DEBUG, "focus cycled on output %lld") \
+    X(EV_CMDBOX_OPEN,     TRACE_INFO,  "cmdbox opened") \
+    X(EV_CMDBOX_CLOSE,    TRACE_INFO,  "cmdbox closed") \
+    X(EV_CMDBOX_KEY,      TRACE_DEBUG, "cmdbox key 0x%llx (%lld chars)") \
+    X(EV_CMDBOX_EXEC,     TRACE_INFO,  "cmdbox exec (%lld chars)") \
+    X(EV_EXIT,            TRACE_INFO,  "exit requested") \
+    X(EV_TXN_APPLY,       TRACE_DEBUG, "output %lld: applied layout for %lld views (%lld not ready)") \
+    X(EV_BG_READY,        TRACE_INFO,  "background %lldx%lld ready (mmapped %lld)") \
+    X(EV_BG_FAILED,       TRACE_WARN,  "background %lldx%lld failed to load") \
+    X(EV_CONFIG_RELOAD,   TRACE_INFO,  "config reloaded: %lld settings changed") \
+    X(EV_CONFIG_REJECTED, TRACE_WARN,  "config reload rejected: %lld errors") \
+    X(EV_KEYMAP_LOADED,   TRACE_INFO,  "keymap ready (from disk cache: %lld) in %lld us") \
+    X(EV_BINDING,         TRACE_DEBUG, "binding action %lld in mode %lld") \
+    X(EV_CHORD_CANCEL,    TRACE_DEBUG, "chord cancelled in mode %lld") \
+    X(EV_SPAWNED,         TRACE_INFO,  "spawn %lld: pid %lld") \
+    X(EV_SPAWN_FAILED,    TRACE_WARN,  "spawn %lld failed: errno %lld") \
+    X(EV_CHILD_EXITED,    TRACE_INFO,  "pid %lld exited with status %lld") \
+    X(EV_CMD_INDEX,       TRACE_INFO,  "command index: %lld entries") \
+    X(EV_CMDBOX_RANK,     TRACE_DEBUG, "cmdbox ranked %lld entries, %lld past prefilter, %lld shown in %lld ns") \
+    X(EV_POINTER_FLUSH,   TRACE_DEBUG, "pointer flushed %lld motion events") \
+    X(EV_OUTPUT_MODESET,  TRACE_INFO,  "modeset %lld outputs in one commit (ok %lld, %lld from cache, %lld fallbacks)") \
+    X(EV_OUTPUT_CONFIG,   TRACE_INFO,  "output configuration ok %lld (test only %lld)") \
+    X(EV_TEARING,         TRACE_INFO,  "output %lld immediate presentation %lld") \
+    X(EV_STARTUP_PHASE,   TRACE_INFO,  "startup phase %lld after %lld us") \
+    X(EV_MEMORY_PRESSURE, TRACE_INFO,  "memory pressure: shrinking %lld hidden views") \
+    X(EV_REPLAY_EVENT,    TRACE_DEBUG, "replay event %lld type %lld: %lld ns late, handled in %lld ns") \
+    X(EV_REPLAY_HOLD,     TRACE_INFO,  "replay event %lld: waited %lld ms for a view to map (mapped %lld)") \
+    X(EV_REPLAY_DONE,     TRACE_INFO,  "replay done: %lld events in %lld us")
+
+enum trace_event {
+#define X(ev, level, fmt) ev,
+    TRACE_EVENTS(X)
+#undef X
+    TRACE_EVENT_COUNT
+};
+
+/* Per-event level constants, so TRACE() can drop events at compile time */
+enum {
+#define X(ev, level, fmt) ev##_LEVEL = level,
+    TRACE_EVENTS(X)
+#undef X
+};
+
+struct trace_header {
+    char magic[8];
+    uint32_t record_size;
+    uint32_t event_count;
+    int64_t realtime_offset_ns;     /* CLOCK_REALTIME - CLOCK_MONOTONIC at start */
+};
+
+struct trace_record {
+    uint64_t ts_ns;                 /* CLOCK_MONOTONIC */
+    uint16_t event;
+    uint8_t level;
+    uint8_t pad[5];
+    int64_t args[4];
+};
+
+#endif
@@ -6,48 +6,326 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <signal.h>
 #include <unistd.h>
 #include <time.h>
 #include <ctype.h>
+#include <errno.h>
+#include <stddef.h>
+#include <stdarg.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <spawn.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
 #include <sys/wait.h>
 #include <pwd.h>
+#include <dirent.h>
+
+#include <png.h>
+#include <ft2build.h>
+#include FT_FREETYPE_H
+#include <fontconfig/fontconfig.h>
+#include <pixman.h>
+#include <drm_fourcc.h>
 
 #include <wayland-server-core.h>
 #include <wlr/backend.h>
+#include <wlr/backend/headless.h>
+#include <wlr/interfaces/wlr_buffer.h>
+#include <wlr/interfaces/wlr_keyboard.h>
+#include <wlr/interfaces/wlr_pointer.h>
 #include <wlr/render/allocator.h>
 #include <wlr/render/wlr_renderer.h>
+#include <wlr/types/wlr_buffer.h>
 #include <wlr/types/wlr_compositor.h>
 #include <wlr/types/wlr_cursor.h>
 #include <wlr/types/wlr_data_device.h>
+#include <wlr/types/wlr_export_dmabuf_v1.h>
 #include <wlr/types/wlr_input_device.h>
 #include <wlr/types/wlr_keyboard.h>
 #include <wlr/types/wlr_output.h>
 #include <wlr/types/wlr_output_layout.h>
+#include <wlr/types/wlr_output_management_v1.h>
+#include <wlr/types/wlr_presentation_time.h>
+#include <wlr/types/wlr_tearing_control_v1.h>
+#include <wlr/types/wlr_content_type_v1.h>
 #include <wlr/types/wlr_pointer.h>
+#include <wlr/types/wlr_relative_pointer_v1.h>
 #include <wlr/types/wlr_seat.h>
 #include <wlr/types/wlr_scene.h>
+#include <wlr/types/wlr_screencopy_v1.h>
 #include <wlr/types/wlr_xcursor_manager.h>
 #include <wlr/types/wlr_xdg_shell.h>
 #include <wlr/util/log.h>
+#include <wlr/config.h>
+#include <wlr/version.h>
+#if WLR_HAS_XWAYLAND
+#include <wlr/xwayland.h>
+#endif
+#if WLR_VERSION_NUM >= ((0 << 16) | (19 << 8) | 0)
+#include <wlr/types/wlr_ext_image_capture_source_v1.h>
+#include <wlr/types/wlr_ext_image_copy_capture_v1.h>
+#define HAVE_EXT_IMAGE_CAPTURE 1
+#endif
 #include <xkbcommon/xkbcommon.h>
 
+#include "eldinwm-trace.h"
+#include "eldinwm-record.h"
+#include "eldinwm-ipc.h"
+#include "eldinwm-layout.h"
+
 #define MAX_WORKSPACES 16
-#define MAX_VIEWS 64
 #define MAX_OUTPUTS 8
 #define MAX_KEYBOARDS 8
-#define VIEWS_PER_WS 2
+#define MAX_VIEWS_PER_WS 256
 #define MAX_CMD_LEN 512
 
+/* Key bindings: chords are up to BIND_MAX_KEYS combos long, and every
+ * chord prefix becomes a one-shot mode of its own */
+#define MAX_BINDINGS 64
+#define MAX_BIND_LEN 256
+#define BIND_MAX_KEYS 4
+#define BIND_TABLE_SIZE 512         /* power of two, >= 2 * MAX_BINDINGS * BIND_MAX_KEYS */
+#define BIND_MAX_MODES 256
+#define BIND_IGNORED_MODS (WLR_MODIFIER_CAPS | WLR_MODIFIER_MOD2)
+
+/* Command index: $PATH executables and .desktop entries */
+#define CMDBOX_MATCHES 8
+#define CMD_MAX_DIRS 64
+#define CMD_RESCAN_DELAY_MS 200
+
+/* Motion is flushed on the next frame, or after this if nothing renders */
+#define POINTER_FLUSH_MS 8
+
+/* Overlay: glyph atlas and cmdbox geometry */
+#define ATLAS_SIZE 512
+#define OVERLAY_PAD 4
+#define OVERLAY_MARGIN 8
+#define CMDBOX_LINES (1 + CMDBOX_MATCHES)
+#define CMDBOX_COLUMNS 60
+
+/* Launcher messages carry one NUL-terminated string */
+#define LAUNCH_DATA_MAX 1024
+
+/* Views are pooled in chunks that never move; VIEW_NONE ends the free list */
+#define VIEW_CHUNK 64
+#define VIEW_NONE UINT32_MAX
+
+/* Frame scheduling */
+#define NSEC_PER_MSEC 1000000LL
+#define NSEC_PER_SEC 1000000000LL
+#define RENDER_SLACK_NS (1 * NSEC_PER_MSEC)
+#define RENDER_TIME_INIT_NS (4 * NSEC_PER_MSEC)
+
+/* Latency histograms: 16 linear sub-buckets per power of two (~6% error),
+ * values up to 2^32 units */
+#define HIST_SUB_BITS 4
+#define HIST_SUB (1 << HIST_SUB_BITS)
+#define HIST_MAX_EXP 32
+#define HIST_BUCKETS ((HIST_MAX_EXP - HIST_SUB_BITS + 2) * HIST_SUB)
+
+/* Input older than this when a commit finally happens did not cause it */
+#define INPUT_STALE_NS (500 * NSEC_PER_MSEC)
+
+/* Modes last committed per monitor (make/model/serial), kept on disk */
+#define MAX_KNOWN_OUTPUTS 32
+
+/* IPC clients; output past IPC_OUT_MAX means the client stopped reading */
+#define IPC_MAX_CLIENTS 32
+#define IPC_OUT_MAX 65536
+
+/* Layout transactions give up waiting for slow clients after this */
+#define TXN_TIMEOUT_MS 200
+
+/* Memory pressure: a PSI trigger on 200 ms of stall within 2 s, the
+ * shortest window unprivileged triggers may use; hidden views stay
+ * shrunk this long after the last one */
+#define PSI_TRIGGER "some 200000 2000000"
+#define PRESSURE_HOLD_MS 10000
+
+/* libxkbcommon's default data directory; XKB_CONFIG_ROOT overrides at runtime */
+#ifndef XKB_CONFIG_ROOT
+#define XKB_CONFIG_ROOT "/usr/share/X11/xkb"
+#endif
+
+/* Trace logger */
+#define TRACE_RING_SIZE 4096
+#define TRACE_BATCH 256
+#define TRACE_FLUSH_NS (10 * NSEC_PER_MSEC)
+
+/* Input recording; a replay waits this long at a recorded map for a
+ * client to map a view too */
+#define RECORD_RING_SIZE 4096
+#define RECORD_FLUSH_NS (10 * NSEC_PER_MSEC)
+#define REPLAY_MAP_WAIT_MS 2000
+
+/* Editors write in bursts; reload once the file has settled */
+#define CONFIG_RELOAD_DELAY_MS 50
+
+/* TRACE(event, args...) - up to four integer args, compiled out below TRACE_LEVEL */
+#define TRACE(...) TRACE_EMIT(__VA_ARGS__, 0, 0, 0, 0, 0)
+#define TRACE_EMIT(ev, a, b, c, d, ...) do { \
+        if ((int)ev##_LEVEL <= (int)TRACE_LEVEL) trace_emit(ev, ev##_LEVEL, a, b, c, d); \
+    } while (0)
+
 struct server;
 struct output;
 struct view;
+struct cmd_index;
+struct overlay;
+struct wlr_xwayland_surface;
 
-/* Simple command box */
+/* Simple command box; matches index server.cmd_index, best first */
 struct cmdbox {
     bool active;
     char text[MAX_CMD_LEN];
     int len;
+    uint32_t matches[CMDBOX_MATCHES];
+    int match_count;
+    int selected;               /* next Tab completes to this match */
+    bool completing;            /* text came from Tab; Tab again cycles */
+};
+
+enum action {
+    ACTION_NONE,                /* unbinds a default */
+    ACTION_EXIT,
+    ACTION_WORKSPACE_NEXT,
+    ACTION_WORKSPACE_PREV,
+    ACTION_WORKSPACE,           /* arg: workspace index */
+    ACTION_FOCUS_CYCLE,
+    ACTION_CMDBOX,
+    ACTION_EXEC,                /* command: shell command line */
+    ACTION_LAYOUT,              /* arg: enum layout, or LAYOUT_COUNT for the next one */
+    ACTION_CHORD,               /* arg: mode entered */
+};
+
+/* One hashed (mode, modifiers, keysym) entry; key 0 marks a free slot */
+struct binding {
+    uint64_t key;
+    enum action action;
+    int arg;
+    const char *command;        /* points into server.config.binds */
+};
+
+struct bindings {
+    struct binding table[BIND_TABLE_SIZE];
+    uint32_t mod_sets[256 / 32];    /* modifier masks bound in mode 0 */
+    int mode_count;
+};
+
+/* Refers to a view without keeping it alive; resolves to NULL once the
+ * view is gone, even if its slot has been reused */
+struct view_handle {
+    uint32_t index;
+    uint32_t generation;
+};
+
+/* Log-linear histogram; recording is a clz and an increment */
+struct histogram {
+    uint32_t counts[HIST_BUCKETS];
+    uint64_t total;
+    uint64_t sum;
+    uint64_t max;
+};
+
+/* A monitor's last good mode, so reconnecting skips probing */
+struct known_output {
+    char key[192];              /* make|model|serial */
+    int32_t width, height, refresh;
+};
+
+/* One connection on the IPC socket */
+struct ipc_client {
+    int fd;
+    struct wl_event_source *source;
+    uint32_t events;            /* IPC_EVENT_* subscribed to */
+    int in_len;
+    int out_len;
+    bool broken;                /* write failed or overflowed; closed when idle */
+    char in[IPC_LINE_MAX];
+    char out[IPC_OUT_MAX];
+};
+
+/* Free list and dense live list, both O(1); no allocation in steady state */
+struct view_pool {
+    struct view **chunks;       /* VIEW_CHUNK views each */
+    uint32_t chunk_count;
+    uint32_t free_head;
+    uint32_t *live;             /* indices of views in use, unordered */
+    uint32_t live_count;
+};
+
+/* Where a newly mapped view goes; each policy falls back to any free slot */
+enum placement {
+    PLACE_FIRST_FREE,           /* lowest workspace on the first output */
+    PLACE_CURRENT_WS,           /* current workspace of each output first */
+    PLACE_FOCUSED_OUTPUT,       /* output of the focused view, else under the cursor */
+    PLACE_LEAST_LOADED,         /* output holding the fewest views */
+};
+
+/* When a frame may be presented without waiting for vblank */
+enum tearing {
+    TEARING_NEVER,
+    TEARING_FULLSCREEN,         /* sole view on the workspace asked for async */
+};
+
+/* What clients on hidden workspaces are told */
+enum hidden_views {
+    HIDDEN_KEEP,                /* nothing, they keep drawing unseen */
+    HIDDEN_SUSPEND,             /* xdg suspended state, X11 minimized */
+    HIDDEN_SHRINK,              /* suspended and configured to a quarter size */
+};
+
+/* Response to memory pressure (PSI) */
+enum memory_pressure {
+    PRESSURE_IGNORE,
+    PRESSURE_SHRINK,            /* shrink hidden views for PRESSURE_HOLD_MS */
+};
+
+/* Startup milestones, each stamped once; see startup_mark(). The socket
+ * and the first lit output are the critical path, the rest is deferred. */
+#define STARTUP_PHASES(X) \
+    X(PHASE_MAIN,        "main") \
+    X(PHASE_CONFIG,      "config") \
+    X(PHASE_RENDERER,    "renderer") \
+    X(PHASE_SOCKET,      "socket") \
+    X(PHASE_BACKEND,     "backend") \
+    X(PHASE_FIRST_FRAME, "first_frame") \
+    X(PHASE_DEFERRED,    "deferred")
+
+enum startup_phase {
+#define X(phase, name) phase,
+    STARTUP_PHASES(X)
+#undef X
+    PHASE_COUNT
+};
+
+/* Settings from eldinwm.conf; the running copy lives in server.config */
+struct config {
+    int workspaces;
+    int placement;              /* enum placement */
+    int layout;                 /* enum layout, for every workspace */
+    int views_per_workspace;
+    int tearing;                /* enum tearing */
+    char font[256];             /* fontconfig pattern for the overlay */
+    char binds[MAX_BINDINGS][MAX_BIND_LEN];     /* validated "keys action [args]" */
+    int bind_count;
+    int max_render_time;        /* ms, 0 = adaptive */
+    int xwayland_idle;          /* s after the last X client, 0 = right away */
+    int hidden_views;           /* enum hidden_views */
+    int memory_pressure;        /* enum memory_pressure */
+    char background_image[PATH_MAX];
 };
 
 /* Server with arrays instead of lists */
@@ -56,6 +334,7 @@ struct server {
     struct wlr_backend *backend;
     struct wlr_renderer *renderer;
     struct wlr_allocator *allocator;
+    struct wlr_compositor *compositor;
     struct wlr_scene *scene;
     struct wlr_scene_output_layout *scene_layout;
     struct wlr_seat *seat;
@@ -73,19 +352,106 @@ struct server {
     struct wl_listener cursor_axis;
     struct wl_listener cursor_frame;
     struct wl_listener request_cursor;
+    
+    /* Pointer motion waits here until the next frame; relative deltas add up */
+    struct wlr_relative_pointer_manager_v1 *relative_pointer;
+    struct wl_event_source *pointer_timer;
+    bool pointer_pending;
+    uint32_t pointer_time;          /* msec of the newest event */
+    double pointer_dx, pointer_dy;
+    double pointer_dx_unaccel, pointer_dy_unaccel;
+    int pointer_events;             /* motion events since the last flush */
+    
+    /* Last surface hit, valid while the scene under it is unchanged */
+    struct wlr_surface *hit_surface;
+    struct wlr_box hit_box;
     struct wl_listener request_set_selection;
+    struct wl_listener layout_change;
     
     struct output *outputs[MAX_OUTPUTS];
     int output_count;
     
-    struct view *views[MAX_VIEWS];
-    int view_count;
+    struct view_pool views;
+    struct view_handle focused;
     
     struct keyboard *keyboards[MAX_KEYBOARDS];
     int keyboard_count;
     
-    int num_workspaces;
+    /* Shared by every keyboard with the same RMLVO; see keymap_get() */
+    struct xkb_context *xkb_context;
+    struct xkb_keymap *keymap;
+    char keymap_key[1024];
+    
+    struct config config;
+    char config_path[PATH_MAX];
+    int config_inotify_fd;
+    int config_wd;
+    bool config_wd_parent;      /* watching a parent: the directory is missing */
+    struct wl_event_source *config_timer;
+    
+    int headless_refresh_mhz;   /* 0 = backend default */
+    int bench_switches;         /* ELDINWM_BENCH: switches per SIGUSR1, 0 = off */
+    char stats_path[512];       /* written on SIGUSR2 */
+    char trace_path[512];       /* empty if tracing is off */
+    int64_t startup_ns[PHASE_COUNT];    /* CLOCK_MONOTONIC, 0 until reached */
+    
+    /* IPC socket and the shared snapshot, republished when idle */
+    int ipc_fd;
+    char ipc_path[512];
+    struct ipc_client *ipc_clients[IPC_MAX_CLIENTS];
+    struct ipc_snapshot *snapshot;
+    char snapshot_path[512];
+    struct wl_event_source *snapshot_idle;
+    struct wl_event_source *ipc_reap_idle;
+    
+    /* New outputs are modeset together once per event loop iteration */
+    struct wl_event_source *outputs_idle;
+    struct wlr_output_manager_v1 *output_manager;
+    struct wlr_tearing_control_manager_v1 *tearing_control;
+    struct wlr_content_type_manager_v1 *content_type;
+    
+    /* Lazy Xwayland: the X socket is reserved up front, the server runs
+     * from the first X connection until xwayland_idle after the last */
+    struct wlr_xwayland *xwayland;
+    struct wlr_scene_tree *unmanaged;   /* override-redirect X windows, on top */
+    struct wl_listener xwayland_ready;
+    struct wl_listener new_xwayland_surface;
+    
+    /* PSI memory trigger, polled through an epoll fd since it signals EPOLLPRI */
+    int pressure_fd;
+    struct wl_event_source *pressure_timer;
+    bool under_pressure;
+    struct wl_listener output_manager_apply;
+    struct wl_listener output_manager_test;
+    struct known_output known_outputs[MAX_KNOWN_OUTPUTS];
+    int known_count;
+    
+    /* Background image, one decoded buffer per output resolution */
+    uint32_t bg_generation;
+    struct bg_buffer *bg_buffers[MAX_OUTPUTS];
+    int bg_count;
+    struct { int width, height; } bg_pending[MAX_OUTPUTS];
+    int bg_pending_count;
+    
+    struct bindings bindings;
+    int bind_mode;              /* 0, or the chord prefix typed so far */
+    
+    /* Spawn helper, see launcher_start() */
+    pid_t launcher_pid;
+    int launcher_fd;
+    struct wl_event_source *launcher_source;
+    uint32_t spawn_serial;
+    int children;
+    
     struct cmdbox cmdbox;
+    struct cmd_index *cmd_index;    /* NULL until the first scan is done */
+    
+    /* Cmdbox overlay and what each of its lines shows now */
+    struct overlay *cmdbox_overlay;
+    struct output *cmdbox_output;
+    char cmdbox_drawn[CMDBOX_LINES][MAX_CMD_LEN + 2];
+    int cmdbox_drawn_sel;
+    int cmdbox_drawn_scroll;
     bool running;
 };
 
@@ -94,27 +460,106 @@ struct output {
     struct server *server;
     struct wlr_output *wlr_output;
     struct wlr_scene_output *scene_output;
+    int id;
+    bool configured;            /* went through the startup batch */
     struct wl_listener frame;
+    struct wl_listener present;
+    struct wl_listener commit;
     struct wl_listener destroy;
     
+    /* Frame scheduling: render as late as possible before vblank */
+    struct wl_event_source *render_timer;
+    bool render_pending;
+    int64_t last_present_ns;
+    int64_t refresh_ns;
+    int64_t render_time_ns;     /* adaptive estimate of commit cost */
+    int64_t target_vblank_ns;   /* vblank the last commit aimed for */
+    uint32_t frames_committed;
+    uint32_t frames_skipped;
+    uint32_t deadlines_missed;
+    bool tearing;               /* last commit was an async page flip */
+    
+    /* Latency stats, dumped on SIGUSR2; times in microseconds */
+    int64_t commit_ns;          /* last commit, until presented */
+    int64_t input_ns;           /* oldest input not yet in a commit */
+    int64_t commit_input_ns;    /* oldest input in the last commit */
+    struct histogram hist_render;
+    struct histogram hist_present;          /* commit to present */
+    struct histogram hist_missed;           /* vblanks missed per frame */
+    struct histogram hist_input;            /* input to present */
+    
+    /* One scene tree per workspace, placed at the output's layout position */
+    struct wlr_scene_tree *tree;
+    struct wlr_scene_tree *ws_trees[MAX_WORKSPACES];
+    struct wlr_scene_buffer *bg_node;   /* shared by all workspaces */
+    struct overlay *indicator;          /* above every workspace */
+    int indicator_count;                /* workspaces drawn */
+    int indicator_ws;                   /* workspace drawn as current */
+    
     int current_ws;
-    struct view *workspaces[MAX_WORKSPACES][VIEWS_PER_WS];
+    
+    /* Views in layout order, packed at the front; slot_take/slot_release
+     * record how far down each workspace changed since its last layout */
+    struct view *workspaces[MAX_WORKSPACES][MAX_VIEWS_PER_WS];
+    int ws_count[MAX_WORKSPACES];
+    enum layout ws_layout[MAX_WORKSPACES];
+    int ws_laid[MAX_WORKSPACES];            /* count at the last layout */
+    int ws_shift[MAX_WORKSPACES];           /* first slot whose view changed */
+    int ws_added[MAX_WORKSPACES];           /* views appended, at the end */
+    int ws_redo[MAX_WORKSPACES];            /* first slot to recompute regardless */
+    uint32_t ws_free;                       /* bit per workspace with a free slot */
+    int view_load;
+    
+    /* Layout transaction: new geometry is applied in one scene update once
+     * every resized view has acked and committed its configure */
+    struct view *txn_views[MAX_WORKSPACES * MAX_VIEWS_PER_WS];
+    int txn_count;
+    int txn_waiting;
+    bool txn_armed;
+    struct wl_event_source *txn_timer;
 };
 
 /* View */
 struct view {
     struct server *server;
-    struct wlr_xdg_toplevel *xdg_toplevel;
-    struct wlr_scene_tree *scene_tree;
+    
+    /* Pool bookkeeping */
+    uint32_t index;
+    uint32_t generation;        /* bumped on free, so old handles go stale */
+    uint32_t next_free;
+    uint32_t live_pos;
+    bool in_use;
+    
+    struct wlr_xdg_toplevel *xdg_toplevel;     /* exactly one of these two */
+    struct wlr_xwayland_surface *xsurface;
+    struct wlr_scene_tree *scene_tree;          /* X11: only while mapped */
     
     struct wl_listener map;
     struct wl_listener unmap;
+    struct wl_listener commit;
     struct wl_listener destroy;
     
+    /* X11 windows get a wl_surface some time after they are created */
+    struct wl_listener associate;
+    struct wl_listener dissociate;
+    struct wl_listener request_configure;
+    
     struct output *output;
     int workspace;
     int ws_slot;
     bool mapped;
+    bool suspended;             /* told it is hidden, see view_set_hidden() */
+    
+    /* Last configured geometry, to avoid redundant configures; 0 after a
+     * shrink, so the next layout sends the full size again */
+    int x, y;
+    int width, height;
+    
+    /* Pending layout transaction */
+    bool in_txn;
+    bool txn_waiting;
+    uint32_t txn_serial;
+    int txn_x, txn_y;
 };
 
 /* Keyboard */
@@ -123,469 +568,5331 @@ struct keyboard {
     struct wlr_keyboard *wlr_keyboard;
     struct wl_listener modifiers;
     struct wl_listener key;
+    
+    /* Keycodes whose press ran a binding; their release isn't forwarded either */
+    uint32_t consumed[1024 / 32];
 };
 
 static struct server g_server = {0};
 
-/* Find space in workspaces */
-static bool find_space(struct server *s, struct output **out_output, int *out_ws, int *out_slot) {
-    for (int i = 0; i < s->output_count; i++) {
-        struct output *o = s->outputs[i];
-        if (!o) continue;
-        
-        for (int ws = 0; ws < s->num_workspaces; ws++) {
-            for (int slot = 0; slot < VIEWS_PER_WS; slot++) {
-                if (o->workspaces[ws][slot] == NULL) {
-                    *out_output = o;
-                    *out_ws = ws;
-                    *out_slot = slot;
-                    return true;
-                }
-            }
-        }
-    }
-    return false;
+static int64_t timespec_to_ns(const struct timespec *ts) {
+    return (int64_t)ts->tv_sec * NSEC_PER_SEC + ts->tv_nsec;
 }
 
-/* Layout workspace */
-static void layout_workspace(struct output *output) {
-    if (!output || !output->wlr_output) return;
-    
-    int width = output->wlr_output->width;
-    int height = output->wlr_output->height;
-    int ws = output->current_ws;
-    
-    fprintf(stderr, "[LAYOUT] Workspace %d\n", ws + 1);
-    
-    /* Hide all views first */
-    for (int i = 0; i < output->server->view_count; i++) {
-        struct view *v = output->server->views[i];
-        if (v && v->mapped && v->scene_tree) {
-            wlr_scene_node_set_enabled(&v->scene_tree->node, false);
-        }
+static int64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return timespec_to_ns(&ts);
+}
+
+/* Start a helper thread with all signals blocked, so the event loop's
+ * signalfds keep receiving them */
+static bool spawn_worker(pthread_t *thread, void *(*fn)(void *), void *data) {
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    int ret = pthread_create(thread, NULL, fn, data);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    return ret == 0;
+}
+
+static uint64_t fnv1a(uint64_t hash, const void *data, size_t len) {
+    const unsigned char *p = data;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= p[i];
+        hash *= 0x100000001b3ULL;
     }
-    
-    /* Count views in current workspace */
-    int count = 0;
-    struct view *visible[2] = {NULL, NULL};
-    
-    for (int slot = 0; slot < VIEWS_PER_WS; slot++) {
-        struct view *v = output->workspaces[ws][slot];
-        if (v && v->mapped) {
-            visible[count++] = v;
-        }
+    return hash;
+}
+
+static void cache_dir(char *out, size_t size) {
+    const char *xdg = getenv("XDG_CACHE_HOME");
+    if (xdg && xdg[0]) {
+        snprintf(out, size, "%s/eldinwm", xdg);
+    } else {
+        const char *home = getenv("HOME");
+        snprintf(out, size, "%s/.cache/eldinwm", home ? home : "/tmp");
     }
+}
+
+static const char *env_or(const char *name, const char *fallback) {
+    const char *value = getenv(name);
+    return value && value[0] ? value : fallback;
+}
+
+/* Trace logger: a lock-free ring of fixed-size records, drained to a
+ * file by a background thread so the event loop never blocks on I/O */
+struct trace_slot {
+    _Atomic uint64_t seq;
+    struct trace_record rec;
+};
+
+static struct {
+    bool enabled;
+    FILE *file;
+    pthread_t thread;
+    atomic_bool stop;
+    _Atomic uint64_t head;
+    _Atomic uint64_t dropped;
+    uint64_t tail;                  /* writer thread only */
+    struct trace_slot slots[TRACE_RING_SIZE];
+} g_trace;
+
+/* Bounded MPMC queue (Vyukov); any thread may emit */
+static void trace_emit(uint16_t event, uint8_t level,
+        int64_t a, int64_t b, int64_t c, int64_t d) {
+    if (!g_trace.enabled) return;
     
-    fprintf(stderr, "[LAYOUT] %d visible views\n", count);
-    
-    /* Layout */
-    if (count == 1 && visible[0]) {
-        wlr_scene_node_set_enabled(&visible[0]->scene_tree->node, true);
-        wlr_scene_node_set_position(&visible[0]->scene_tree->node, 0, 0);
-        wlr_xdg_toplevel_set_size(visible[0]->xdg_toplevel, width, height);
-    } else if (count == 2) {
-        int half = width / 2;
-        for (int i = 0; i < 2; i++) {
-            if (visible[i]) {
-                wlr_scene_node_set_enabled(&visible[i]->scene_tree->node, true);
-                wlr_scene_node_set_position(&visible[i]->scene_tree->node, i * half, 0);
-                wlr_xdg_toplevel_set_size(visible[i]->xdg_toplevel, half, height);
+    struct trace_slot *slot;
+    uint64_t pos = atomic_load_explicit(&g_trace.head, memory_order_relaxed);
+    for (;;) {
+        slot = &g_trace.slots[pos % TRACE_RING_SIZE];
+        uint64_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        int64_t diff = (int64_t)(seq - pos);
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&g_trace.head, &pos, pos + 1,
+                    memory_order_relaxed, memory_order_relaxed)) {
+                break;
             }
+        } else if (diff < 0) {
+            atomic_fetch_add_explicit(&g_trace.dropped, 1, memory_order_relaxed);
+            return;
+        } else {
+            pos = atomic_load_explicit(&g_trace.head, memory_order_relaxed);
         }
     }
+    
+    slot->rec = (struct trace_record){
+        .ts_ns = now_ns(), .event = event, .level = level, .args = {a, b, c, d},
+    };
+    atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
 }
 
-static void exec_command(const char *cmd) {
-    if (!cmd || !cmd[0]) return;
-    if (fork() == 0) {
-        setsid();
-        execl("/bin/sh", "/bin/sh", "-lc", cmd, NULL);
-        _exit(1);
+static size_t trace_drain(struct trace_record *out, size_t max) {
+    size_t n = 0;
+    while (n < max) {
+        struct trace_slot *slot = &g_trace.slots[g_trace.tail % TRACE_RING_SIZE];
+        uint64_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        if (seq != g_trace.tail + 1) break;
+        out[n++] = slot->rec;
+        atomic_store_explicit(&slot->seq, g_trace.tail + TRACE_RING_SIZE,
+            memory_order_release);
+        g_trace.tail++;
     }
+    return n;
 }
 
-static void cycle_focus(struct server *s) {
-    fprintf(stderr, "[FOCUS] Cycling\n");
+static void *trace_thread(void *data) {
+    struct trace_record batch[TRACE_BATCH];
+    uint64_t reported = 0;
+    const struct timespec nap = { .tv_nsec = TRACE_FLUSH_NS };
     
-    for (int i = 0; i < s->output_count; i++) {
-        struct output *o = s->outputs[i];
-        if (!o) continue;
-        
-        int ws = o->current_ws;
-        struct view *v0 = o->workspaces[ws][0];
-        struct view *v1 = o->workspaces[ws][1];
+    for (;;) {
+        bool stopping = atomic_load(&g_trace.stop);
+        size_t n = trace_drain(batch, TRACE_BATCH);
+        if (n > 0) fwrite(batch, sizeof(batch[0]), n, g_trace.file);
         
-        if (v0 && v1 && v0->mapped && v1->mapped) {
-            struct wlr_surface *focused = s->seat->keyboard_state.focused_surface;
-            struct view *other = (v0->xdg_toplevel->base->surface == focused) ? v1 : v0;
-            
-            wlr_seat_keyboard_notify_enter(s->seat, other->xdg_toplevel->base->surface, NULL, 0, NULL);
-            fprintf(stderr, "[FOCUS] Cycled\n");
+        uint64_t dropped = atomic_load_explicit(&g_trace.dropped, memory_order_relaxed);
+        if (dropped != reported) {
+            struct trace_record rec = {
+                .ts_ns = now_ns(), .event = EV_TRACE_DROPPED,
+                .level = EV_TRACE_DROPPED_LEVEL, .args = {(int64_t)(dropped - reported)},
+            };
+            fwrite(&rec, sizeof(rec), 1, g_trace.file);
+            reported = dropped;
         }
+        
+        if (n == TRACE_BATCH) continue;
+        if (stopping) break;
+        fflush(g_trace.file);
+        nanosleep(&nap, NULL);
     }
+    
+    fflush(g_trace.file);
+    return NULL;
 }
 
-static void handle_key(struct server *s, xkb_keysym_t sym, uint32_t mods) {
-    uint32_t ctrl_shift = WLR_MODIFIER_CTRL | WLR_MODIFIER_SHIFT;
-    
-    /* Command box mode */
-    if (s->cmdbox.active) {
-        fprintf(stderr, "[CMDBOX] Key: %d\n", sym);
-        
-        if (sym == XKB_KEY_Escape) {
-            s->cmdbox.active = false;
-            s->cmdbox.len = 0;
-            s->cmdbox.text[0] = '\0';
-            fprintf(stderr, "[CMDBOX] Closed\n");
-        } else if (sym == XKB_KEY_Return) {
-            if (s->cmdbox.len > 0) {
-                fprintf(stderr, "[CMDBOX] Exec: %s\n", s->cmdbox.text);
-                exec_command(s->cmdbox.text);
-            }
-            s->cmdbox.active = false;
-            s->cmdbox.len = 0;
-            s->cmdbox.text[0] = '\0';
-        } else if (sym == XKB_KEY_BackSpace) {
-            if (s->cmdbox.len > 0) {
-                s->cmdbox.len--;
-                s->cmdbox.text[s->cmdbox.len] = '\0';
-                fprintf(stderr, "[CMDBOX] %s\n", s->cmdbox.text);
-            }
-        } else if (sym >= 32 && sym < 127 && s->cmdbox.len < MAX_CMD_LEN - 1) {
-            s->cmdbox.text[s->cmdbox.len++] = (char)sym;
-            s->cmdbox.text[s->cmdbox.len] = '\0';
-            fprintf(stderr, "[CMDBOX] %s\n", s->cmdbox.text);
-        }
+/* Creates or truncates a file only we can read; the default paths may be
+ * in a shared /tmp, so a link planted there is refused, not followed */
+static FILE *fopen_private(const char *path) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW | O_CLOEXEC, 0600);
+    if (fd < 0) return NULL;
+    fchmod(fd, 0600);           /* a file left by an older run keeps its mode */
+    FILE *f = fdopen(fd, "w");
+    if (!f) close(fd);
+    return f;
+}
+
+static void trace_init(const char *path) {
+    g_trace.file = fopen_private(path);
+    if (!g_trace.file) {
+        fprintf(stderr, "Trace: cannot open %s\n", path);
         return;
     }
     
-    /* Global shortcuts */
-    if (mods != ctrl_shift) return;
+    struct timespec mono, real;
+    clock_gettime(CLOCK_MONOTONIC, &mono);
+    clock_gettime(CLOCK_REALTIME, &real);
+    struct trace_header header = {
+        .magic = TRACE_MAGIC,
+        .record_size = sizeof(struct trace_record),
+        .event_count = TRACE_EVENT_COUNT,
+        .realtime_offset_ns = timespec_to_ns(&real) - timespec_to_ns(&mono),
+    };
+    fwrite(&header, sizeof(header), 1, g_trace.file);
     
-    switch (sym) {
-        case XKB_KEY_Down:
-            fprintf(stderr, "[EXIT] Bye\n");
-            wl_display_terminate(s->display);
-            s->running = false;
-            break;
-            
-        case XKB_KEY_Left:
-        case XKB_KEY_Right: {
-            fprintf(stderr, "[WORKSPACE] Switch attempt (outputs: %d)\n", s->output_count);
-            
-            int delta = (sym == XKB_KEY_Right) ? 1 : -1;
-            
-            for (int i = 0; i < s->output_count; i++) {
-                struct output *o = s->outputs[i];
-                if (!o) {
-                    fprintf(stderr, "[WORKSPACE] Output %d is NULL\n", i);
-                    continue;
-                }
-                
-                int new_ws = o->current_ws + delta;
-                fprintf(stderr, "[WORKSPACE] Output %d: %d -> %d\n", i, o->current_ws, new_ws);
-                
-                if (new_ws >= 0 && new_ws < s->num_workspaces) {
-                    o->current_ws = new_ws;
-                    fprintf(stderr, "[WORKSPACE] Switched to %d, calling layout\n", new_ws + 1);
-                    layout_workspace(o);
-                    fprintf(stderr, "[WORKSPACE] Layout done\n");
-                } else {
-                    fprintf(stderr, "[WORKSPACE] Out of bounds\n");
-                }
-            }
-            
-            fprintf(stderr, "[WORKSPACE] Switch complete\n");
-            break;
-        }
-        
-        case XKB_KEY_z:
-        case XKB_KEY_Z:
-            fprintf(stderr, "[CMDBOX] Opening\n");
-            s->cmdbox.active = true;
-            s->cmdbox.len = 0;
-            s->cmdbox.text[0] = '\0';
-            fprintf(stderr, "[CMDBOX] Ready\n");
-            break;
-            
-        case XKB_KEY_x:
-        case XKB_KEY_X:
-            cycle_focus(s);
-            break;
+    for (uint64_t i = 0; i < TRACE_RING_SIZE; i++) {
+        atomic_init(&g_trace.slots[i].seq, i);
+    }
+    g_trace.enabled = true;
+    if (!spawn_worker(&g_trace.thread, trace_thread, NULL)) {
+        g_trace.enabled = false;
+        fclose(g_trace.file);
     }
-    
-    fprintf(stderr, "[KEY] Handler done\n");
 }
 
-static void kb_modifiers(struct wl_listener *listener, void *data) {
-    struct keyboard *kb = wl_container_of(listener, kb, modifiers);
-    wlr_seat_set_keyboard(kb->server->seat, kb->wlr_keyboard);
-    wlr_seat_keyboard_notify_modifiers(kb->server->seat, &kb->wlr_keyboard->modifiers);
+static void trace_finish(void) {
+    if (!g_trace.enabled) return;
+    g_trace.enabled = false;
+    atomic_store(&g_trace.stop, true);
+    pthread_join(g_trace.thread, NULL);
+    fclose(g_trace.file);
 }
 
-static void kb_key(struct wl_listener *listener, void *data) {
-    struct keyboard *kb = wl_container_of(listener, kb, key);
-    struct wlr_keyboard_key_event *event = data;
+/* Input recorder: the event loop is the only producer, so a single
+ * producer ring is enough; a thread writes it out like the trace */
+static struct {
+    bool enabled;
+    FILE *file;
+    pthread_t thread;
+    atomic_bool stop;
+    _Atomic uint64_t head;          /* event loop */
+    _Atomic uint64_t tail;          /* writer thread */
+    uint32_t dropped;               /* event loop */
+    int64_t start_ns;
+    struct input_record ring[RECORD_RING_SIZE];
+} g_record;
+
+static void record_emit(enum record_type type, uint32_t code, int32_t value,
+        double x, double y, double ux, double uy) {
+    if (!g_record.enabled) return;
     
-    if (event->state == WL_KEYBOARD_KEY_STATE_PRESSED) {
-        const xkb_keysym_t *syms;
-        int nsyms = xkb_state_key_get_syms(kb->wlr_keyboard->xkb_state, 
-            event->keycode + 8, &syms);
-        uint32_t mods = wlr_keyboard_get_modifiers(kb->wlr_keyboard);
-        
-        for (int i = 0; i < nsyms; i++) {
-            handle_key(kb->server, syms[i], mods);
-        }
+    uint64_t head = atomic_load_explicit(&g_record.head, memory_order_relaxed);
+    if (head - atomic_load_explicit(&g_record.tail, memory_order_acquire) == RECORD_RING_SIZE) {
+        g_record.dropped++;
+        return;
     }
+    g_record.ring[head % RECORD_RING_SIZE] = (struct input_record){
+        .ts_ns = now_ns() - g_record.start_ns, .type = type, .code = code, .value = value,
+        .x = x, .y = y, .ux = ux, .uy = uy,
+    };
+    atomic_store_explicit(&g_record.head, head + 1, memory_order_release);
+}
+
+static void *record_thread(void *data) {
+    const struct timespec nap = { .tv_nsec = RECORD_FLUSH_NS };
+    uint64_t tail = 0;
     
-    wlr_seat_set_keyboard(kb->server->seat, kb->wlr_keyboard);
-    wlr_seat_keyboard_notify_key(kb->server->seat, event->time_msec,
-        event->keycode, event->state);
+    for (;;) {
+        bool stopping = atomic_load(&g_record.stop);
+        uint64_t head = atomic_load_explicit(&g_record.head, memory_order_acquire);
+        while (tail != head) {
+            uint64_t n = head - tail;
+            uint64_t contiguous = RECORD_RING_SIZE - tail % RECORD_RING_SIZE;
+            if (n > contiguous) n = contiguous;
+            fwrite(&g_record.ring[tail % RECORD_RING_SIZE], sizeof(g_record.ring[0]), n,
+                g_record.file);
+            tail += n;
+            atomic_store_explicit(&g_record.tail, tail, memory_order_release);
+        }
+        
+        if (stopping) break;
+        fflush(g_record.file);
+        nanosleep(&nap, NULL);
+    }
+    return NULL;
 }
 
-static void new_keyboard(struct server *s, struct wlr_input_device *device) {
-    if (s->keyboard_count >= MAX_KEYBOARDS) return;
+/* Every keycode typed goes in here, so nobody else may read it */
+static void record_init(const char *path) {
+    g_record.file = fopen_private(path);
+    if (!g_record.file) {
+        fprintf(stderr, "Record: cannot open %s\n", path);
+        return;
+    }
     
-    struct wlr_keyboard *wlr_kb = wlr_keyboard_from_input_device(device);
-    struct keyboard *kb = calloc(1, sizeof(*kb));
-    kb->server = s;
-    kb->wlr_keyboard = wlr_kb;
+    struct timespec real;
+    clock_gettime(CLOCK_REALTIME, &real);
+    struct record_header header = {
+        .magic = RECORD_MAGIC,
+        .record_size = sizeof(struct input_record),
+        .realtime_start_ns = timespec_to_ns(&real),
+    };
+    fwrite(&header, sizeof(header), 1, g_record.file);
     
-    struct xkb_context *ctx = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
-    struct xkb_keymap *keymap = xkb_keymap_new_from_names(ctx, NULL, XKB_KEYMAP_COMPILE_NO_FLAGS);
-    wlr_keyboard_set_keymap(wlr_kb, keymap);
-    xkb_keymap_unref(keymap);
-    xkb_context_unref(ctx);
-    wlr_keyboard_set_repeat_info(wlr_kb, 25, 600);
+    g_record.start_ns = now_ns();
+    g_record.enabled = true;
+    if (!spawn_worker(&g_record.thread, record_thread, NULL)) {
+        g_record.enabled = false;
+        fclose(g_record.file);
+    }
+}
+
+/* The header learns how much was lost once nothing more can be */
+static void record_finish(void) {
+    if (!g_record.enabled) return;
+    g_record.enabled = false;
+    atomic_store(&g_record.stop, true);
+    pthread_join(g_record.thread, NULL);
     
-    kb->modifiers.notify = kb_modifiers;
-    wl_signal_add(&wlr_kb->events.modifiers, &kb->modifiers);
-    kb->key.notify = kb_key;
-    wl_signal_add(&wlr_kb->events.key, &kb->key);
+    if (g_record.dropped) {
+        fprintf(stderr, "Record: %u events dropped, ring full\n", g_record.dropped);
+        fseek(g_record.file, offsetof(struct record_header, dropped), SEEK_SET);
+        fwrite(&g_record.dropped, sizeof(g_record.dropped), 1, g_record.file);
+    }
+    fclose(g_record.file);
+}
+
+/* Replay: a recording fed back through a virtual keyboard and pointer on
+ * the headless backend, paced by a timerfd. Recorded maps are sync
+ * points: the replay holds there until a client maps a view, so clients
+ * started alongside it (eldinwm-bench -P) line up with the input. */
+static struct {
+    const struct input_record *records;     /* mmapped file */
+    size_t count, next;
+    void *map;
+    size_t map_size;
+    double speed;                   /* 1 = as recorded, 0 = as fast as possible */
     
-    wlr_seat_set_keyboard(s->seat, wlr_kb);
-    s->keyboards[s->keyboard_count++] = kb;
+    int timer_fd;
+    struct wl_event_source *source;
+    int64_t start_ns;
+    int64_t base_ns;                /* when recorded time 0 is due */
+    int64_t due_ns;                 /* as fast as possible: previous event done */
+    int64_t hold_ns;                /* waiting at a recorded map since, 0 if not */
+    int64_t held_ns;
+    int views_expected;             /* recorded maps minus unmaps so far */
+    int views_mapped;
     
-    fprintf(stderr, "[INPUT] Keyboard added (%d total)\n", s->keyboard_count);
+    bool devices;
+    struct wlr_keyboard keyboard;
+    struct wlr_pointer pointer;
+    struct wlr_output *outputs[MAX_OUTPUTS];    /* by recorded output id */
+    
+    struct histogram lag[RECORD_TYPE_COUNT];    /* due to dispatched */
+    struct histogram handle[RECORD_TYPE_COUNT]; /* dispatched to handled */
+} g_replay = {
+    .timer_fd = -1,
+};
+
+static void replay_arm(int64_t at_ns) {
+    if (g_replay.timer_fd < 0) return;
+    if (at_ns < 1) at_ns = 1;       /* zero would disarm */
+    struct itimerspec when = {
+        .it_value = { .tv_sec = at_ns / NSEC_PER_SEC, .tv_nsec = at_ns % NSEC_PER_SEC },
+    };
+    timerfd_settime(g_replay.timer_fd, TFD_TIMER_ABSTIME, &when, NULL);
 }
 
-static void process_cursor_motion(struct server *s, uint32_t time) {
-    wlr_seat_pointer_notify_motion(s->seat, time, s->cursor->x, s->cursor->y);
+static void replay_view_mapped(int delta) {
+    g_replay.views_mapped += delta;
+    if (delta > 0 && g_replay.hold_ns) replay_arm(now_ns());
 }
 
-static void cursor_motion(struct wl_listener *listener, void *data) {
-    struct server *s = wl_container_of(listener, s, cursor_motion);
-    struct wlr_pointer_motion_event *event = data;
-    wlr_cursor_move(s->cursor, &event->pointer->base, event->delta_x, event->delta_y);
-    process_cursor_motion(s, event->time_msec);
+static int hist_index(uint64_t v) {
+    if (v < HIST_SUB) return (int)v;
+    if (v >> HIST_MAX_EXP) v = (1ull << HIST_MAX_EXP) - 1;
+    int exp = 63 - __builtin_clzll(v);
+    return (exp - HIST_SUB_BITS + 1) * HIST_SUB +
+        (int)((v >> (exp - HIST_SUB_BITS)) & (HIST_SUB - 1));
 }
 
-static void cursor_motion_absolute(struct wl_listener *listener, void *data) {
-    struct server *s = wl_container_of(listener, s, cursor_motion_absolute);
-    struct wlr_pointer_motion_absolute_event *event = data;
-    wlr_cursor_warp_absolute(s->cursor, &event->pointer->base, event->x, event->y);
-    process_cursor_motion(s, event->time_msec);
+/* Lowest value that lands in a bucket */
+static uint64_t hist_value(int index) {
+    if (index < HIST_SUB) return index;
+    int exp = index / HIST_SUB + HIST_SUB_BITS - 1;
+    return (uint64_t)(HIST_SUB + index % HIST_SUB) << (exp - HIST_SUB_BITS);
 }
 
-static void cursor_button(struct wl_listener *listener, void *data) {
-    struct server *s = wl_container_of(listener, s, cursor_button);
-    struct wlr_pointer_button_event *event = data;
-    wlr_seat_pointer_notify_button(s->seat, event->time_msec, event->button, event->state);
+static void hist_record(struct histogram *h, uint64_t v) {
+    h->counts[hist_index(v)]++;
+    h->total++;
+    h->sum += v;
+    if (v > h->max) h->max = v;
 }
 
-static void cursor_axis(struct wl_listener *listener, void *data) {
-    struct server *s = wl_container_of(listener, s, cursor_axis);
-    struct wlr_pointer_axis_event *event = data;
-    wlr_seat_pointer_notify_axis(s->seat, event->time_msec,
-        event->orientation, event->delta, event->delta_discrete, event->source,
-        event->relative_direction);
+static uint64_t hist_percentile(const struct histogram *h, double p) {
+    uint64_t want = (uint64_t)(h->total * p / 100.0 + 0.5), seen = 0;
+    if (want == 0) want = 1;
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        seen += h->counts[i];
+        if (seen >= want) return hist_value(i);
+    }
+    return h->max;
 }
 
-static void cursor_frame(struct wl_listener *listener, void *data) {
-    struct server *s = wl_container_of(listener, s, cursor_frame);
-    wlr_seat_pointer_notify_frame(s->seat);
+static const char *const phase_names[] = {
+#define X(phase, name) name,
+    STARTUP_PHASES(X)
+#undef X
+};
+
+/* Printed once the deferred work is in, so it stays off the critical path */
+static void startup_banner(struct server *s) {
+    fprintf(stderr, "\n");
+    fprintf(stderr, "══════════════════════════════════════\n");
+    fprintf(stderr, "       ElDinWM - Ready                \n");
+    fprintf(stderr, "══════════════════════════════════════\n");
+    fprintf(stderr, "\n");
+    fprintf(stderr, "WAYLAND_DISPLAY=%s\n", env_or("WAYLAND_DISPLAY", ""));
+    fprintf(stderr, "Workspaces: %d\n", s->config.workspaces);
+    if (g_trace.enabled) fprintf(stderr, "Trace: %s\n", s->trace_path);
+    fprintf(stderr, "Stats: %s (on SIGUSR2)\n", s->stats_path);
+    if (s->ipc_fd >= 0) fprintf(stderr, "IPC: %s\n", s->ipc_path);
+    fprintf(stderr, "Startup:");
+    for (int i = PHASE_MAIN + 1; i < PHASE_COUNT; i++) {
+        if (!s->startup_ns[i]) continue;
+        fprintf(stderr, " %s %.1f ms", phase_names[i],
+            (s->startup_ns[i] - s->startup_ns[PHASE_MAIN]) / (double)NSEC_PER_MSEC);
+    }
+    fprintf(stderr, "\n\n");
+    fprintf(stderr, "KEYS:\n");
+    for (int i = 0; i < s->config.bind_count; i++) {
+        fprintf(stderr, "  %s\n", s->config.binds[i]);
+    }
+    fprintf(stderr, "\n");
 }
 
-static void request_cursor(struct wl_listener *listener, void *data) {
-    struct server *s = wl_container_of(listener, s, request_cursor);
-    struct wlr_seat_pointer_request_set_cursor_event *event = data;
-    if (s->seat->pointer_state.focused_client == event->seat_client) {
-        wlr_cursor_set_surface(s->cursor, event->surface, event->hotspot_x, event->hotspot_y);
+/* Each phase is stamped the first time it is reached. In bench mode the
+ * full set goes to stdout once the first output is lit and the deferred
+ * work is in, for eldinwm-bench -S. */
+static void startup_mark(struct server *s, enum startup_phase phase) {
+    if (s->startup_ns[phase]) return;
+    s->startup_ns[phase] = now_ns();
+    TRACE(EV_STARTUP_PHASE, phase, (s->startup_ns[phase] - s->startup_ns[PHASE_MAIN]) / 1000);
+    
+    if (phase == PHASE_DEFERRED) startup_banner(s);
+    if ((phase == PHASE_DEFERRED || phase == PHASE_FIRST_FRAME) && s->bench_switches > 0 &&
+            s->startup_ns[PHASE_DEFERRED] && s->startup_ns[PHASE_FIRST_FRAME]) {
+        printf("{\"event\":\"startup\",\"us\":{");
+        for (int i = 0; i < PHASE_COUNT; i++) {
+            printf("%s\"%s\":%lld", i ? "," : "", phase_names[i],
+                (long long)((s->startup_ns[i] - s->startup_ns[PHASE_MAIN]) / 1000));
+        }
+        printf("}}\n");
+        fflush(stdout);
     }
 }
 
-static void request_set_selection(struct wl_listener *listener, void *data) {
-    struct server *s = wl_container_of(listener, s, request_set_selection);
-    struct wlr_seat_request_set_selection_event *event = data;
-    wlr_seat_set_selection(s->seat, event->source, event->serial);
+/* Overlays, keymaps and the cursor image wait for the startup worker */
+static bool startup_deferred_done(struct server *s) {
+    return s->startup_ns[PHASE_DEFERRED] != 0;
 }
 
-static void new_pointer(struct server *s, struct wlr_input_device *device) {
-    wlr_cursor_attach_input_device(s->cursor, device);
+/* Input-to-present starts at the first input event after each commit */
+static void input_stamp(struct server *s) {
+    int64_t now = 0;
+    for (int i = 0; i < s->output_count; i++) {
+        struct output *o = s->outputs[i];
+        if (!o || o->input_ns) continue;
+        if (!now) now = now_ns();
+        o->input_ns = now;
+    }
 }
 
-static void new_input(struct wl_listener *listener, void *data) {
-    struct server *s = wl_container_of(listener, s, new_input);
-    struct wlr_input_device *device = data;
-    
-    switch (device->type) {
-        case WLR_INPUT_DEVICE_KEYBOARD:
-            new_keyboard(s, device);
+static struct view *view_at(struct view_pool *pool, uint32_t index) {
+    return &pool->chunks[index / VIEW_CHUNK][index % VIEW_CHUNK];
+}
+
+static bool view_pool_grow(struct view_pool *pool) {
+    uint32_t n = pool->chunk_count;
+    struct view **chunks = realloc(pool->chunks, (n + 1) * sizeof(*chunks));
+    if (!chunks) return false;
+    pool->chunks = chunks;
+    uint32_t *live = realloc(pool->live, (n + 1) * VIEW_CHUNK * sizeof(*live));
+    if (!live) return false;
+    pool->live = live;
+    chunks[n] = calloc(VIEW_CHUNK, sizeof(struct view));
+    if (!chunks[n]) return false;
+    
+    /* Thread the new slots onto the free list, lowest index first */
+    for (uint32_t i = VIEW_CHUNK; i-- > 0; ) {
+        struct view *v = &chunks[n][i];
+        v->index = n * VIEW_CHUNK + i;
+        v->generation = 1;      /* a zeroed handle never matches */
+        v->next_free = pool->free_head;
+        pool->free_head = v->index;
+    }
+    pool->chunk_count = n + 1;
+    return true;
+}
+
+/* Returns a zeroed view; its generation tells it apart from earlier tenants */
+static struct view *view_alloc(struct view_pool *pool) {
+    if (pool->free_head == VIEW_NONE && !view_pool_grow(pool)) return NULL;
+    
+    struct view *v = view_at(pool, pool->free_head);
+    uint32_t index = v->index, generation = v->generation;
+    pool->free_head = v->next_free;
+    memset(v, 0, sizeof(*v));
+    v->index = index;
+    v->generation = generation;
+    v->in_use = true;
+    v->live_pos = pool->live_count;
+    pool->live[pool->live_count++] = index;
+    return v;
+}
+
+static void view_free(struct view_pool *pool, struct view *v) {
+    uint32_t last = pool->live[--pool->live_count];
+    pool->live[v->live_pos] = last;
+    view_at(pool, last)->live_pos = v->live_pos;
+    
+    v->in_use = false;
+    v->generation++;
+    v->next_free = pool->free_head;
+    pool->free_head = v->index;
+}
+
+static struct view_handle view_handle(struct view *v) {
+    return (struct view_handle){ .index = v->index, .generation = v->generation };
+}
+
+static struct view *view_get(struct view_pool *pool, struct view_handle h) {
+    if (h.index >= pool->chunk_count * VIEW_CHUNK) return NULL;
+    struct view *v = view_at(pool, h.index);
+    return v->in_use && v->generation == h.generation ? v : NULL;
+}
+
+/* xdg-shell and X11 views differ only where these are used */
+static struct wlr_surface *view_surface(struct view *v) {
+#if WLR_HAS_XWAYLAND
+    if (v->xsurface) return v->xsurface->surface;
+#endif
+    return v->xdg_toplevel->base->surface;
+}
+
+static const char *view_app_id(struct view *v) {
+#if WLR_HAS_XWAYLAND
+    if (v->xsurface) return v->xsurface->class;
+#endif
+    return v->xdg_toplevel->app_id;
+}
+
+static void view_pool_finish(struct view_pool *pool) {
+    for (uint32_t i = 0; i < pool->chunk_count; i++) {
+        free(pool->chunks[i]);
+    }
+    free(pool->chunks);
+    free(pool->live);
+}
+
+_Static_assert(MAX_WORKSPACES <= 32, "occupancy masks are 32 bits");
+
+/* Slots from here on get new geometry on the next layout_workspace() */
+static void slot_dirty(struct output *o, int ws, int slot) {
+    if (slot < o->ws_redo[ws]) o->ws_redo[ws] = slot;
+}
+
+static void slot_free_update(struct output *o, int ws) {
+    if (o->ws_count[ws] < o->server->config.views_per_workspace) {
+        o->ws_free |= 1u << ws;
+    } else {
+        o->ws_free &= ~(1u << ws);
+    }
+}
+
+/* Appends; slot is always the workspace's count, as output_find_slot gives */
+static void slot_take(struct output *o, int ws, int slot, struct view *v) {
+    o->workspaces[ws][slot] = v;
+    o->ws_count[ws] = slot + 1;
+    o->ws_added[ws]++;
+    if (slot < o->ws_shift[ws]) o->ws_shift[ws] = slot;
+    slot_free_update(o, ws);
+    o->view_load++;
+}
+
+/* Closes the gap, so every view after it moves up a slot */
+static void slot_release(struct output *o, int ws, int slot) {
+    int count = --o->ws_count[ws];
+    if (slot > count - o->ws_added[ws]) o->ws_added[ws]--;
+    for (int i = slot; i < count; i++) {
+        o->workspaces[ws][i] = o->workspaces[ws][i + 1];
+        o->workspaces[ws][i]->ws_slot = i;
+    }
+    o->workspaces[ws][count] = NULL;
+    if (slot < o->ws_shift[ws]) o->ws_shift[ws] = slot;
+    slot_free_update(o, ws);
+    o->view_load--;
+}
+
+/* Who gets focus when the view in a slot leaves: its successor, else its
+ * predecessor */
+static struct view *slot_neighbour(struct output *o, int ws, int slot) {
+    int count = o->ws_count[ws];
+    if (count == 0) return NULL;
+    return o->workspaces[ws][slot < count ? slot : count - 1];
+}
+
+/* Lowest free slot on one output, optionally trying its current workspace first */
+static bool output_find_slot(struct output *o, int num_ws, bool current_first,
+        int *out_ws, int *out_slot) {
+    uint32_t avail = o->ws_free & ((1u << num_ws) - 1);
+    if (!avail) return false;
+    
+    int ws = __builtin_ctz(avail);
+    if (current_first && (avail & (1u << o->current_ws))) ws = o->current_ws;
+    *out_ws = ws;
+    *out_slot = o->ws_count[ws];
+    return true;
+}
+
+static struct output *focused_output(struct server *s) {
+    struct view *v = view_get(&s->views, s->focused);
+    if (v && v->output) return v->output;
+    
+    struct wlr_output *wlr_output = wlr_output_layout_output_at(s->output_layout,
+        s->cursor->x, s->cursor->y);
+    for (int i = 0; i < s->output_count; i++) {
+        if (s->outputs[i] && s->outputs[i]->wlr_output == wlr_output) return s->outputs[i];
+    }
+    return NULL;
+}
+
+/* Find space in workspaces, according to the placement policy; disabled
+ * outputs have none */
+static bool find_space(struct server *s, struct output **out_output, int *out_ws, int *out_slot) {
+    int policy = s->config.placement;
+    bool current_first = policy != PLACE_FIRST_FREE;
+    
+    struct output *first = NULL;
+    if (policy == PLACE_FOCUSED_OUTPUT) {
+        first = focused_output(s);
+        if (first && !first->wlr_output->enabled) first = NULL;
+    } else if (policy == PLACE_LEAST_LOADED) {
+        for (int i = 0; i < s->output_count; i++) {
+            struct output *o = s->outputs[i];
+            if (o && o->wlr_output->enabled &&
+                    (o->ws_free & ((1u << s->config.workspaces) - 1)) &&
+                    (!first || o->view_load < first->view_load)) {
+                first = o;
+            }
+        }
+    }
+    if (first && output_find_slot(first, s->config.workspaces, current_first, out_ws, out_slot)) {
+        *out_output = first;
+        return true;
+    }
+    
+    for (int i = 0; i < s->output_count; i++) {
+        struct output *o = s->outputs[i];
+        if (o && o != first && o->wlr_output->enabled &&
+                output_find_slot(o, s->config.workspaces, current_first, out_ws, out_slot)) {
+            *out_output = o;
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Pointer: scene hit testing, with the last surface cached while the
+ * pointer stays inside it. Only view root surfaces with nothing stacked on
+ * them are cached, so a box and input region check is exact. */
+/* Whether anything enabled under node, at layout offset (x, y), covers part
+ * of box. Buffers count at their destination size, as the scene draws them. */
+static bool scene_node_overlaps(struct wlr_scene_node *node, int x, int y,
+        const struct wlr_box *box) {
+    if (!node->enabled) return false;
+    x += node->x;
+    y += node->y;
+    
+    struct wlr_box extent = { x, y, 0, 0 };
+    switch (node->type) {
+        case WLR_SCENE_NODE_TREE: {
+            struct wlr_scene_node *child;
+            wl_list_for_each(child, &wlr_scene_tree_from_node(node)->children, link) {
+                if (scene_node_overlaps(child, x, y, box)) return true;
+            }
+            return false;
+        }
+        case WLR_SCENE_NODE_RECT: {
+            struct wlr_scene_rect *rect = wlr_scene_rect_from_node(node);
+            extent.width = rect->width;
+            extent.height = rect->height;
             break;
-        case WLR_INPUT_DEVICE_POINTER:
-            new_pointer(s, device);
+        }
+        case WLR_SCENE_NODE_BUFFER: {
+            struct wlr_scene_buffer *buffer = wlr_scene_buffer_from_node(node);
+            extent.width = buffer->dst_width ? buffer->dst_width :
+                buffer->buffer ? buffer->buffer->width : 0;
+            extent.height = buffer->dst_height ? buffer->dst_height :
+                buffer->buffer ? buffer->buffer->height : 0;
             break;
-        default:
+        }
+    }
+    struct wlr_box common;
+    return wlr_box_intersection(&common, &extent, box);
+}
+
+/* Whether something is stacked above node inside box: everything after it
+ * in its own tree and in each tree up to the root */
+static bool scene_covered(struct wlr_scene_node *node, const struct wlr_box *box) {
+    for (; node->parent; node = &node->parent->node) {
+        int x = 0, y = 0;
+        wlr_scene_node_coords(&node->parent->node, &x, &y);
+        for (struct wl_list *l = node->link.next; l != &node->parent->children; l = l->next) {
+            struct wlr_scene_node *above = wl_container_of(l, above, link);
+            if (scene_node_overlaps(above, x, y, box)) return true;
+        }
+    }
+    return false;
+}
+
+static struct wlr_surface *surface_at(struct server *s, double lx, double ly,
+        double *sx, double *sy) {
+    struct wlr_box *box = &s->hit_box;
+    if (s->hit_surface && lx >= box->x && ly >= box->y &&
+            lx < box->x + box->width && ly < box->y + box->height) {
+        *sx = lx - box->x;
+        *sy = ly - box->y;
+        if (pixman_region32_contains_point(&s->hit_surface->input_region,
+                (int)*sx, (int)*sy, NULL)) {
+            return s->hit_surface;
+        }
+    }
+    s->hit_surface = NULL;
+    
+    struct wlr_scene_node *node = wlr_scene_node_at(&s->scene->tree.node, lx, ly, sx, sy);
+    if (!node || node->type != WLR_SCENE_NODE_BUFFER) return NULL;
+    struct wlr_scene_surface *scene_surface =
+        wlr_scene_surface_try_from_buffer(wlr_scene_buffer_from_node(node));
+    if (!scene_surface) return NULL;
+    
+    /* Only a box nothing else is drawn over: a monocle sibling, an X menu
+     * or an overlay would otherwise keep losing input to the cached view */
+    struct wlr_surface *surface = scene_surface->surface;
+    if (wlr_xdg_toplevel_try_from_wlr_surface(surface) &&
+            wl_list_empty(&surface->current.subsurfaces_above) &&
+            wlr_scene_node_coords(node, &box->x, &box->y)) {
+        box->width = surface->current.width;
+        box->height = surface->current.height;
+        if (!scene_covered(node, box)) s->hit_surface = surface;
+    }
+    return surface;
+}
+
+/* Send what accumulated since the last flush as one motion and one frame */
+static void pointer_flush(struct server *s) {
+    if (!s->pointer_pending) return;
+    s->pointer_pending = false;
+    wl_event_source_timer_update(s->pointer_timer, 0);
+    
+    double sx, sy;
+    struct wlr_surface *surface = surface_at(s, s->cursor->x, s->cursor->y, &sx, &sy);
+    if (!surface) {
+        if (s->seat->pointer_state.focused_surface) {
+            wlr_seat_pointer_clear_focus(s->seat);
+            if (s->cursor_mgr) wlr_cursor_set_xcursor(s->cursor, s->cursor_mgr, "default");
+        }
+    } else {
+        wlr_seat_pointer_notify_enter(s->seat, surface, sx, sy);
+    }
+    
+    if (s->pointer_dx || s->pointer_dy || s->pointer_dx_unaccel || s->pointer_dy_unaccel) {
+        wlr_relative_pointer_manager_v1_send_relative_motion(s->relative_pointer, s->seat,
+            (uint64_t)s->pointer_time * 1000, s->pointer_dx, s->pointer_dy,
+            s->pointer_dx_unaccel, s->pointer_dy_unaccel);
+        s->pointer_dx = s->pointer_dy = 0;
+        s->pointer_dx_unaccel = s->pointer_dy_unaccel = 0;
+    }
+    if (surface) wlr_seat_pointer_notify_motion(s->seat, s->pointer_time, sx, sy);
+    wlr_seat_pointer_notify_frame(s->seat);
+    
+    TRACE(EV_POINTER_FLUSH, s->pointer_events);
+    s->pointer_events = 0;
+}
+
+static int pointer_timeout(void *data) {
+    pointer_flush(data);
+    return 0;
+}
+
+/* Hold motion until the next frame of the output under the cursor */
+static void pointer_schedule(struct server *s) {
+    if (s->pointer_pending) return;
+    s->pointer_pending = true;
+    
+    int ms = POINTER_FLUSH_MS;
+    struct wlr_output *wlr_output = wlr_output_layout_output_at(s->output_layout,
+        s->cursor->x, s->cursor->y);
+    for (int i = 0; i < s->output_count; i++) {
+        struct output *o = s->outputs[i];
+        if (o && o->wlr_output == wlr_output && o->refresh_ns > 0) {
+            ms = (int)((o->refresh_ns + NSEC_PER_MSEC - 1) / NSEC_PER_MSEC);
+        }
+    }
+    wl_event_source_timer_update(s->pointer_timer, ms);
+}
+
+/* The scene moved: drop the cached hit and re-check focus on the next flush */
+static void pointer_rehit(struct server *s) {
+    s->hit_surface = NULL;
+    if (!s->pointer_pending) s->pointer_time = (uint32_t)(now_ns() / NSEC_PER_MSEC);
+    pointer_schedule(s);
+}
+
+/* IPC: events go out as they happen; the snapshot is rewritten once per
+ * event loop iteration however many changes it had */
+static void ipc_client_close(struct server *s, struct ipc_client *c) {
+    for (int i = 0; i < IPC_MAX_CLIENTS; i++) {
+        if (s->ipc_clients[i] == c) s->ipc_clients[i] = NULL;
+    }
+    wl_event_source_remove(c->source);
+    close(c->fd);
+    free(c);
+}
+
+static void ipc_reap(void *data) {
+    struct server *s = data;
+    s->ipc_reap_idle = NULL;
+    for (int i = 0; i < IPC_MAX_CLIENTS; i++) {
+        if (s->ipc_clients[i] && s->ipc_clients[i]->broken) {
+            ipc_client_close(s, s->ipc_clients[i]);
+        }
+    }
+}
+
+/* Callers may still be using the client, so closing waits for idle */
+static void ipc_client_break(struct server *s, struct ipc_client *c) {
+    c->broken = true;
+    c->out_len = 0;
+    if (!s->ipc_reap_idle) {
+        s->ipc_reap_idle = wl_event_loop_add_idle(wl_display_get_event_loop(s->display),
+            ipc_reap, s);
+    }
+}
+
+static void ipc_flush(struct server *s, struct ipc_client *c) {
+    int done = 0;
+    while (done < c->out_len) {
+        ssize_t n = write(c->fd, c->out + done, c->out_len - done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && errno == EAGAIN) break;
+        if (n <= 0) {
+            ipc_client_break(s, c);
+            return;
+        }
+        done += n;
+    }
+    memmove(c->out, c->out + done, c->out_len - done);
+    c->out_len -= done;
+    wl_event_source_fd_update(c->source,
+        WL_EVENT_READABLE | (c->out_len ? WL_EVENT_WRITABLE : 0));
+}
+
+/* Queue output; a client too slow to drain IPC_OUT_MAX is dropped */
+static void ipc_send(struct server *s, struct ipc_client *c, const char *data, size_t len) {
+    if (c->broken) return;
+    if (len > sizeof(c->out) - c->out_len) {
+        ipc_client_break(s, c);
+        return;
+    }
+    bool idle = c->out_len == 0;
+    memcpy(c->out + c->out_len, data, len);
+    c->out_len += len;
+    if (idle) ipc_flush(s, c);
+}
+
+static void ipc_event(struct server *s, uint32_t event, const char *fmt, ...) {
+    char line[IPC_LINE_MAX];
+    int len = 0;
+    for (int i = 0; i < IPC_MAX_CLIENTS; i++) {
+        struct ipc_client *c = s->ipc_clients[i];
+        if (!c || !(c->events & event)) continue;
+        if (!len) {
+            va_list args;
+            va_start(args, fmt);
+            len = vsnprintf(line, sizeof(line) - 1, fmt, args);
+            va_end(args);
+            if (len < 0) return;
+            if (len > (int)sizeof(line) - 2) len = sizeof(line) - 2;
+            line[len++] = '\n';
+        }
+        ipc_send(s, c, line, len);
+    }
+}
+
+static void snapshot_view(struct ipc_view *out, struct view *v) {
+    if (!v) {
+        memset(out, 0, sizeof(*out));
+        return;
+    }
+    out->index = v->index;
+    out->generation = v->generation;
+    snprintf(out->app_id, sizeof(out->app_id), "%s", view_app_id(v) ? view_app_id(v) : "");
+}
+
+_Static_assert(MAX_WORKSPACES <= IPC_MAX_WORKSPACES, "the snapshot holds every workspace");
+
+static void snapshot_publish(void *data) {
+    struct server *s = data;
+    struct ipc_snapshot *snap = s->snapshot;
+    s->snapshot_idle = NULL;
+    
+    uint32_t seq = atomic_load_explicit(&snap->seq, memory_order_relaxed);
+    atomic_store_explicit(&snap->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    
+    struct view *focused = view_get(&s->views, s->focused);
+    snap->workspaces = s->config.workspaces;
+    snap->output_count = 0;
+    snap->focused_output = -1;
+    snapshot_view(&snap->focused, focused);
+    for (int i = 0; i < s->output_count && snap->output_count < IPC_MAX_OUTPUTS; i++) {
+        struct output *o = s->outputs[i];
+        if (!o) continue;
+        if (focused && focused->output == o) snap->focused_output = snap->output_count;
+        
+        struct ipc_output *out = &snap->outputs[snap->output_count++];
+        snprintf(out->name, sizeof(out->name), "%s", o->wlr_output->name);
+        out->current_ws = o->current_ws;
+        out->occupied = 0;
+        for (int ws = 0; ws < MAX_WORKSPACES; ws++) {
+            if (o->ws_count[ws]) out->occupied |= 1u << ws;
+            out->view_counts[ws] = o->ws_count[ws];
+            for (int slot = 0; slot < IPC_VIEWS_PER_WS; slot++) {
+                snapshot_view(&out->slots[ws][slot],
+                    slot < o->ws_count[ws] ? o->workspaces[ws][slot] : NULL);
+            }
+        }
+    }
+    
+    atomic_store_explicit(&snap->seq, seq + 2, memory_order_release);
+}
+
+static void ipc_changed(struct server *s) {
+    if (!s->snapshot || s->snapshot_idle) return;
+    s->snapshot_idle = wl_event_loop_add_idle(wl_display_get_event_loop(s->display),
+        snapshot_publish, s);
+}
+
+/* Keyboard focus goes through here so IPC sees every change */
+static void view_focus(struct server *s, struct view *v) {
+    struct view_handle h = v ? view_handle(v) : (struct view_handle){ 0 };
+    if (v) {
+        wlr_seat_keyboard_notify_enter(s->seat, view_surface(v), NULL, 0, NULL);
+        /* Monocle stacks every view in the same place */
+        if (v->scene_tree) {
+            wlr_scene_node_raise_to_top(&v->scene_tree->node);
+            pointer_rehit(s);
+        }
+    }
+    if (h.index == s->focused.index && h.generation == s->focused.generation) return;
+#if WLR_HAS_XWAYLAND
+    /* X11 clients track focus themselves and need telling */
+    struct view *old = view_get(&s->views, s->focused);
+    if (old && old->xsurface) wlr_xwayland_surface_activate(old->xsurface, false);
+    if (v && v->xsurface) wlr_xwayland_surface_activate(v->xsurface, true);
+#endif
+    s->focused = h;
+    ipc_event(s, IPC_EVENT_FOCUS, "event focus %u:%u", h.index, h.generation);
+    ipc_changed(s);
+}
+
+static void txn_apply(struct output *output) {
+    TRACE(EV_TXN_APPLY, output->id, output->txn_count, output->txn_waiting);
+    
+    for (int i = 0; i < output->txn_count; i++) {
+        struct view *v = output->txn_views[i];
+        wlr_scene_node_set_position(&v->scene_tree->node, v->txn_x, v->txn_y);
+        wlr_scene_node_set_enabled(&v->scene_tree->node, true);
+        v->x = v->txn_x;
+        v->y = v->txn_y;
+#if WLR_HAS_XWAYLAND
+        /* X11 wants the position too, in layout coordinates, for its popups */
+        int lx, ly;
+        if (v->xsurface && wlr_scene_node_coords(&v->scene_tree->node, &lx, &ly)) {
+            wlr_xwayland_surface_configure(v->xsurface, lx, ly, v->width, v->height);
+        }
+#endif
+        v->in_txn = false;
+        v->txn_waiting = false;
+    }
+    
+    output->txn_count = 0;
+    output->txn_waiting = 0;
+    output->txn_armed = false;
+    wl_event_source_timer_update(output->txn_timer, 0);
+    pointer_rehit(output->server);
+}
+
+static int txn_timeout(void *data) {
+    txn_apply(data);
+    return 0;
+}
+
+/* Queue new geometry for a view; only sends a configure when the size changes */
+static void txn_add(struct output *output, struct view *view, int x, int y, int width, int height) {
+    bool resize = view->width != width || view->height != height;
+    bool move = view->x != x || view->y != y;
+    if (!resize && !move && !view->in_txn) return;
+    
+    if (!view->in_txn) {
+        view->in_txn = true;
+        output->txn_views[output->txn_count++] = view;
+    }
+    view->txn_x = x;
+    view->txn_y = y;
+    
+    /* X11 has no acks; its configure goes out with the apply */
+    if (resize) {
+        view->width = width;
+        view->height = height;
+    }
+    if (resize && !view->xsurface) {
+        view->txn_serial = wlr_xdg_toplevel_set_size(view->xdg_toplevel, width, height);
+        if (!view->txn_waiting) {
+            view->txn_waiting = true;
+            output->txn_waiting++;
+        }
+    }
+}
+
+static void txn_remove(struct output *output, struct view *view) {
+    if (!view->in_txn) return;
+    
+    for (int i = 0; i < output->txn_count; i++) {
+        if (output->txn_views[i] == view) {
+            output->txn_views[i] = output->txn_views[--output->txn_count];
             break;
+        }
+    }
+    if (view->txn_waiting) output->txn_waiting--;
+    view->in_txn = false;
+    view->txn_waiting = false;
+    
+    if (output->txn_count > 0 && output->txn_waiting == 0) txn_apply(output);
+}
+
+/* Apply right away if no client has to redraw, otherwise wait (bounded) */
+static void txn_commit(struct output *output) {
+    if (output->txn_count == 0) return;
+    
+    if (output->txn_waiting == 0) {
+        txn_apply(output);
+    } else if (!output->txn_armed) {
+        output->txn_armed = true;
+        wl_event_source_timer_update(output->txn_timer, TXN_TIMEOUT_MS);
+    }
+}
+
+/* Views nobody can see stop drawing: suspended (xdg-shell 6) or minimized
+ * (X11). Under the shrink policy, or memory pressure, xdg views are also
+ * configured to a quarter of their size so they drop their big buffers;
+ * they get the full size back in a layout transaction when shown. */
+static bool hidden_shrink(struct server *s) {
+    return s->config.hidden_views == HIDDEN_SHRINK || s->under_pressure;
+}
+
+static void view_set_hidden(struct view *v, bool hidden) {
+    struct server *s = v->server;
+    bool suspend = hidden && s->config.hidden_views != HIDDEN_KEEP;
+    if (suspend != v->suspended) {
+        v->suspended = suspend;
+#if WLR_HAS_XWAYLAND
+        if (v->xsurface) wlr_xwayland_surface_set_minimized(v->xsurface, suspend);
+#endif
+        if (v->xdg_toplevel) wlr_xdg_toplevel_set_suspended(v->xdg_toplevel, suspend);
+    }
+    
+    /* Its size is gone, so the layout has to hand it out again; like a new
+     * view it stays hidden until that transaction applies */
+    if (hidden && hidden_shrink(s) && v->xdg_toplevel && v->mapped && v->width > 0 && !v->in_txn) {
+        wlr_xdg_toplevel_set_size(v->xdg_toplevel,
+            v->width / 4 > 0 ? v->width / 4 : 1, v->height / 4 > 0 ? v->height / 4 : 1);
+        wlr_scene_node_set_enabled(&v->scene_tree->node, false);
+        v->width = v->height = 0;
+        if (v->output) slot_dirty(v->output, v->workspace, v->ws_slot);
+    }
+}
+
+static void workspace_set_hidden(struct output *output, int ws, bool hidden) {
+    for (int slot = 0; slot < output->ws_count[ws]; slot++) {
+        view_set_hidden(output->workspaces[ws][slot], hidden);
+    }
+}
+
+/* Layout one workspace of an output, visible or not. Only slots whose
+ * rectangle can have changed since the last call are recomputed, so
+ * adding or removing a view costs what it moves, not the workspace size. */
+static void layout_workspace(struct output *output, int ws) {
+    if (!output || !output->wlr_output) return;
+    
+    int count = output->ws_count[ws];
+    enum layout layout = output->ws_layout[ws];
+    int first = layout_first_changed(layout, output->ws_laid[ws], count,
+        output->ws_shift[ws], output->ws_added[ws]);
+    if (output->ws_redo[ws] < first) first = output->ws_redo[ws];
+    
+    TRACE(EV_LAYOUT, output->id, ws + 1, count);
+    
+    /* Views new to their slot may have come from another workspace; shrunk
+     * views keep their slots dirty until the workspace is shown */
+    bool hidden = ws != output->current_ws;
+    for (int slot = first; slot < count; slot++) {
+        view_set_hidden(output->workspaces[ws][slot], hidden);
+    }
+    if (hidden && hidden_shrink(output->server)) return;
+    
+    int width = output->wlr_output->width;
+    int height = output->wlr_output->height;
+    for (int slot = first; slot < count; slot++) {
+        struct view *v = output->workspaces[ws][slot];
+        if (!v->mapped) continue;
+        struct layout_rect r = layout_rect(layout, slot, count, width, height);
+        txn_add(output, v, r.x, r.y, r.width, r.height);
+    }
+    output->ws_laid[ws] = count;
+    output->ws_shift[ws] = MAX_VIEWS_PER_WS;
+    output->ws_redo[ws] = MAX_VIEWS_PER_WS;
+    output->ws_added[ws] = 0;
+    
+    txn_commit(output);
+}
+
+/* Overlay: the workspace indicator and cmdbox are drawn on the CPU into
+ * small buffers, text coming from an a8 glyph atlas that is rasterized
+ * once per glyph. A change repaints only the cells it touches and hands
+ * exactly those to the scene as damage. */
+struct glyph {
+    int16_t x, y;               /* in the atlas */
+    uint16_t width, height;
+    int16_t left, top;          /* bearing from the pen on the baseline */
+    bool ready;
+};
+
+static struct {
+    FT_Library library;
+    FT_Face face;
+    pixman_image_t *atlas;
+    int pen_x, pen_y, row_height;
+    struct glyph glyphs[128];
+    int ascent, line_height, advance;   /* pixels, monospace advance */
+    bool loaded, failed;
+} g_font;
+
+struct overlay {
+    struct wlr_buffer base;
+    pixman_image_t *image;
+    uint32_t *pixels;
+    int stride;
+    struct wlr_scene_buffer *node;
+    pixman_region32_t damage;           /* since the last commit */
+};
+
+/* Premultiplied */
+static const pixman_color_t overlay_bg = { 3342, 5013, 7242, 55705 };
+static const pixman_color_t overlay_accent = { 13107, 26214, 52428, 65535 };
+static const pixman_color_t overlay_fg = { 65535, 65535, 65535, 65535 };
+static const pixman_color_t overlay_dim = { 43690, 43690, 43690, 65535 };
+static const pixman_color_t overlay_clear = { 0, 0, 0, 0 };
+
+static void font_unload(void) {
+    if (g_font.face) FT_Done_Face(g_font.face);
+    if (g_font.library) FT_Done_FreeType(g_font.library);
+    if (g_font.atlas) pixman_image_unref(g_font.atlas);
+    memset(&g_font, 0, sizeof(g_font));
+}
+
+static bool font_load(const char *spec) {
+    if (g_font.loaded || g_font.failed) return g_font.loaded;
+    g_font.failed = true;
+    
+    FcPattern *pattern = FcNameParse((const FcChar8 *)spec);
+    if (!pattern) return false;
+    FcConfigSubstitute(NULL, pattern, FcMatchPattern);
+    FcDefaultSubstitute(pattern);
+    FcResult result;
+    FcPattern *match = FcFontMatch(NULL, pattern, &result);
+    FcPatternDestroy(pattern);
+    if (!match) return false;
+    
+    FcChar8 *file;
+    int index = 0;
+    double pixel_size = 16;
+    FcPatternGetInteger(match, FC_INDEX, 0, &index);
+    FcPatternGetDouble(match, FC_PIXEL_SIZE, 0, &pixel_size);
+    bool ok = FcPatternGetString(match, FC_FILE, 0, &file) == FcResultMatch &&
+        FT_Init_FreeType(&g_font.library) == 0 &&
+        FT_New_Face(g_font.library, (const char *)file, index, &g_font.face) == 0 &&
+        FT_Set_Pixel_Sizes(g_font.face, 0, (FT_UInt)(pixel_size + 0.5)) == 0 &&
+        FT_Load_Char(g_font.face, 'M', FT_LOAD_DEFAULT) == 0;
+    FcPatternDestroy(match);
+    if (ok) g_font.atlas = pixman_image_create_bits(PIXMAN_a8, ATLAS_SIZE, ATLAS_SIZE, NULL, 0);
+    if (!ok || !g_font.atlas) {
+        font_unload();
+        g_font.failed = true;
+        fprintf(stderr, "Overlay: cannot load font '%s', overlay disabled\n", spec);
+        return false;
+    }
+    
+    const FT_Size_Metrics *m = &g_font.face->size->metrics;
+    g_font.ascent = (int)((m->ascender + 63) >> 6);
+    g_font.line_height = (int)((m->height + 63) >> 6);
+    g_font.advance = (int)((g_font.face->glyph->advance.x + 63) >> 6);
+    g_font.loaded = true;
+    g_font.failed = false;
+    return true;
+}
+
+/* Rasterize into the atlas on first use; anything but ASCII shows as '?' */
+static const struct glyph *glyph_get(unsigned char c) {
+    if (c < 32 || c > 126) c = '?';
+    struct glyph *g = &g_font.glyphs[c];
+    if (g->ready) return g;
+    g->ready = true;
+    
+    if (FT_Load_Char(g_font.face, c, FT_LOAD_RENDER) != 0) return g;
+    FT_GlyphSlot slot = g_font.face->glyph;
+    const FT_Bitmap *bm = &slot->bitmap;
+    if (bm->pixel_mode != FT_PIXEL_MODE_GRAY || bm->pitch < 0) return g;
+    
+    if (g_font.pen_x + (int)bm->width > ATLAS_SIZE) {
+        g_font.pen_x = 0;
+        g_font.pen_y += g_font.row_height + 1;
+        g_font.row_height = 0;
+    }
+    if (g_font.pen_y + (int)bm->rows > ATLAS_SIZE) return g;
+    
+    uint8_t *dst = (uint8_t *)pixman_image_get_data(g_font.atlas);
+    int stride = pixman_image_get_stride(g_font.atlas);
+    for (unsigned int y = 0; y < bm->rows; y++) {
+        memcpy(dst + (g_font.pen_y + y) * stride + g_font.pen_x,
+            bm->buffer + y * bm->pitch, bm->width);
+    }
+    g->x = g_font.pen_x;
+    g->y = g_font.pen_y;
+    g->width = bm->width;
+    g->height = bm->rows;
+    g->left = slot->bitmap_left;
+    g->top = slot->bitmap_top;
+    g_font.pen_x += bm->width + 1;
+    if ((int)bm->rows > g_font.row_height) g_font.row_height = bm->rows;
+    return g;
+}
+
+static void overlay_buffer_destroy(struct wlr_buffer *wlr_buffer) {
+    struct overlay *ov = wl_container_of(wlr_buffer, ov, base);
+    pixman_image_unref(ov->image);
+    free(ov->pixels);
+    free(ov);
+}
+
+static bool overlay_buffer_begin_access(struct wlr_buffer *wlr_buffer, uint32_t flags,
+        void **data, uint32_t *format, size_t *stride) {
+    struct overlay *ov = wl_container_of(wlr_buffer, ov, base);
+    if (flags & WLR_BUFFER_DATA_PTR_ACCESS_WRITE) return false;
+    *data = ov->pixels;
+    *format = DRM_FORMAT_ARGB8888;
+    *stride = ov->stride;
+    return true;
+}
+
+static void overlay_buffer_end_access(struct wlr_buffer *wlr_buffer) {
+}
+
+static const struct wlr_buffer_impl overlay_buffer_impl = {
+    .destroy = overlay_buffer_destroy,
+    .begin_data_ptr_access = overlay_buffer_begin_access,
+    .end_data_ptr_access = overlay_buffer_end_access,
+};
+
+/* Starts fully transparent and on top of its parent */
+static struct overlay *overlay_create(struct wlr_scene_tree *parent, int width, int height) {
+    struct overlay *ov = calloc(1, sizeof(*ov));
+    if (!ov) return NULL;
+    ov->stride = width * 4;
+    ov->pixels = calloc((size_t)height, ov->stride);
+    ov->image = ov->pixels ? pixman_image_create_bits(PIXMAN_a8r8g8b8, width, height,
+        ov->pixels, ov->stride) : NULL;
+    if (!ov->image) {
+        free(ov->pixels);
+        free(ov);
+        return NULL;
+    }
+    wlr_buffer_init(&ov->base, &overlay_buffer_impl, width, height);
+    pixman_region32_init(&ov->damage);
+    ov->node = wlr_scene_buffer_create(parent, &ov->base);
+    wlr_scene_node_raise_to_top(&ov->node->node);
+    return ov;
+}
+
+static void overlay_destroy(struct overlay *ov) {
+    if (!ov) return;
+    wlr_scene_node_destroy(&ov->node->node);
+    pixman_region32_fini(&ov->damage);
+    wlr_buffer_drop(&ov->base);
+}
+
+static void overlay_fill(struct overlay *ov, int x, int y, int width, int height,
+        const pixman_color_t *color) {
+    if (width <= 0 || height <= 0) return;
+    pixman_box32_t box = { x, y, x + width, y + height };
+    pixman_image_fill_boxes(PIXMAN_OP_SRC, ov->image, color, 1, &box);
+    pixman_region32_union_rect(&ov->damage, &ov->damage, x, y, width, height);
+}
+
+/* Text over an area that was just filled, so it adds no damage of its own */
+static void overlay_text(struct overlay *ov, int x, int baseline, const char *text, int len,
+        const pixman_color_t *color) {
+    pixman_image_t *src = pixman_image_create_solid_fill(color);
+    for (int i = 0; i < len; i++, x += g_font.advance) {
+        const struct glyph *g = glyph_get((unsigned char)text[i]);
+        if (g->width == 0) continue;
+        pixman_image_composite32(PIXMAN_OP_OVER, src, g_font.atlas, ov->image, 0, 0,
+            g->x, g->y, x + g->left, baseline - g->top, g->width, g->height);
+    }
+    pixman_image_unref(src);
+}
+
+/* Upload only what changed since the last commit */
+static void overlay_commit(struct overlay *ov) {
+    if (!pixman_region32_not_empty(&ov->damage)) return;
+    wlr_scene_buffer_set_buffer_with_damage(ov->node, &ov->base, &ov->damage);
+    pixman_region32_fini(&ov->damage);
+    pixman_region32_init(&ov->damage);
+}
+
+static int indicator_cell_width(void) {
+    return 2 * g_font.advance + 2 * OVERLAY_PAD;
+}
+
+static void indicator_draw_cell(struct output *o, int ws) {
+    int cw = indicator_cell_width();
+    bool current = ws == o->current_ws;
+    overlay_fill(o->indicator, ws * cw, 0, cw, g_font.line_height + 2 * OVERLAY_PAD,
+        current ? &overlay_accent : &overlay_bg);
+    
+    char label[4];
+    int n = snprintf(label, sizeof(label), "%d", ws + 1);
+    overlay_text(o->indicator, ws * cw + (cw - n * g_font.advance) / 2,
+        OVERLAY_PAD + g_font.ascent, label, n, current ? &overlay_fg : &overlay_dim);
+}
+
+/* Top-right workspace strip; a switch repaints just the two cells involved */
+static void indicator_update(struct output *o) {
+    struct server *s = o->server;
+    if (!startup_deferred_done(s) || !font_load(s->config.font)) return;
+    
+    int count = s->config.workspaces;
+    if (!o->indicator || o->indicator_count != count) {
+        overlay_destroy(o->indicator);
+        o->indicator = overlay_create(o->tree, count * indicator_cell_width(),
+            g_font.line_height + 2 * OVERLAY_PAD);
+        if (!o->indicator) return;
+        o->indicator_count = count;
+        pointer_rehit(s);
+        for (int ws = 0; ws < count; ws++) {
+            indicator_draw_cell(o, ws);
+        }
+    } else if (o->indicator_ws != o->current_ws) {
+        if (o->indicator_ws < count) indicator_draw_cell(o, o->indicator_ws);
+        indicator_draw_cell(o, o->current_ws);
+    }
+    o->indicator_ws = o->current_ws;
+    
+    wlr_scene_node_set_position(&o->indicator->node->node,
+        o->wlr_output->width - count * indicator_cell_width() - OVERLAY_MARGIN, OVERLAY_MARGIN);
+    overlay_commit(o->indicator);
+}
+
+/* Switching is a single subtree toggle; geometry is kept up to date per workspace */
+static void switch_workspace(struct output *output, int ws) {
+    if (ws == output->current_ws) return;
+    wlr_scene_node_set_enabled(&output->ws_trees[output->current_ws]->node, false);
+    wlr_scene_node_set_enabled(&output->ws_trees[ws]->node, true);
+    workspace_set_hidden(output, output->current_ws, true);
+    workspace_set_hidden(output, ws, false);
+    output->current_ws = ws;
+    
+    /* Restores sizes a shrink took away */
+    layout_workspace(output, ws);
+    indicator_update(output);
+    pointer_rehit(output->server);
+    ipc_event(output->server, IPC_EVENT_WORKSPACE, "event workspace %s %d",
+        output->wlr_output->name, ws + 1);
+    ipc_changed(output->server);
+}
+
+/* Launcher: a helper forked at startup, before wlroots maps any GPU
+ * memory, that spawns commands and reaps them. The compositor never forks;
+ * it only sends a SEQPACKET message and hears back asynchronously. */
+enum launcher_msg_type {
+    LAUNCH_SETENV,              /* data: NAME=value, for later spawns */
+    LAUNCH_EXEC,                /* data: shell command line */
+    LAUNCH_STARTED,             /* pid, or status = errno */
+    LAUNCH_EXITED,              /* pid and wait status */
+};
+
+struct launcher_msg {
+    uint32_t type;
+    uint32_t id;
+    int32_t pid;
+    int32_t status;
+    char data[LAUNCH_DATA_MAX];
+};
+
+extern char **environ;
+
+static void launcher_reply(int fd, uint32_t type, uint32_t id, pid_t pid, int status) {
+    struct launcher_msg msg = { .type = type, .id = id, .pid = pid, .status = status };
+    send(fd, &msg, offsetof(struct launcher_msg, data) + 1, MSG_NOSIGNAL);
+}
+
+/* Runs in the helper; returns when the compositor goes away */
+static void launcher_run(int fd) {
+    /* Own session, so terminal signals aimed at the compositor miss us */
+    setsid();
+    
+    /* Under eldinwm-bench stdout is its results pipe; children writing to
+     * it, or just holding it open, would corrupt or stall the report */
+    if (getenv("ELDINWM_BENCH")) {
+        int null = open("/dev/null", O_WRONLY | O_CLOEXEC);
+        if (null >= 0) {
+            dup2(null, STDOUT_FILENO);
+            close(null);
+        }
+    }
+    
+    sigset_t chld, none, all;
+    sigemptyset(&chld);
+    sigaddset(&chld, SIGCHLD);
+    sigemptyset(&none);
+    sigfillset(&all);
+    sigprocmask(SIG_BLOCK, &chld, NULL);
+    int sfd = signalfd(-1, &chld, SFD_NONBLOCK | SFD_CLOEXEC);
+    
+    /* Children start with a clean signal state in their own process group */
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+    posix_spawnattr_setsigmask(&attr, &none);
+    posix_spawnattr_setsigdefault(&attr, &all);
+    posix_spawnattr_setpgroup(&attr, 0);
+    posix_spawnattr_setflags(&attr,
+        POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETPGROUP);
+    
+    struct pollfd pfds[2] = {
+        { .fd = fd, .events = POLLIN },
+        { .fd = sfd, .events = POLLIN },
+    };
+    for (;;) {
+        if (poll(pfds, sfd >= 0 ? 2 : 1, -1) < 0) continue;
+        
+        if (pfds[1].revents & POLLIN) {
+            struct signalfd_siginfo info;
+            while (read(sfd, &info, sizeof(info)) == sizeof(info)) {}
+            int status;
+            pid_t pid;
+            while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+                launcher_reply(fd, LAUNCH_EXITED, 0, pid, status);
+            }
+        }
+        if (!(pfds[0].revents & (POLLIN | POLLHUP))) continue;
+        
+        struct launcher_msg msg;
+        ssize_t n = recv(fd, &msg, sizeof(msg), 0);
+        if (n <= 0) break;
+        if ((size_t)n <= offsetof(struct launcher_msg, data)) continue;
+        msg.data[sizeof(msg.data) - 1] = '\0';
+        
+        if (msg.type == LAUNCH_SETENV) {
+            char *eq = strchr(msg.data, '=');
+            if (eq) {
+                *eq = '\0';
+                setenv(msg.data, eq + 1, 1);
+            }
+        } else if (msg.type == LAUNCH_EXEC) {
+            char *argv[] = { "/bin/sh", "-lc", msg.data, NULL };
+            pid_t pid = -1;
+            int err = posix_spawn(&pid, "/bin/sh", NULL, &attr, argv, environ);
+            launcher_reply(fd, LAUNCH_STARTED, msg.id, err ? -1 : pid, err);
+        }
+    }
+    posix_spawnattr_destroy(&attr);
+}
+
+/* Call before any thread or GPU state exists; exec falls back to nothing
+ * if this fails, the compositor itself never forks */
+static void launcher_start(struct server *s) {
+    s->launcher_fd = -1;
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) != 0) return;
+    
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(sv[0]);
+        close(sv[1]);
+        return;
+    }
+    if (pid == 0) {
+        close(sv[0]);
+        launcher_run(sv[1]);
+        _exit(0);
+    }
+    close(sv[1]);
+    s->launcher_pid = pid;
+    s->launcher_fd = sv[0];
+}
+
+static bool launcher_send(struct server *s, uint32_t type, uint32_t id, const char *data) {
+    if (s->launcher_fd < 0) return false;
+    struct launcher_msg msg = { .type = type, .id = id };
+    size_t len = strlen(data);
+    if (len >= sizeof(msg.data)) return false;
+    memcpy(msg.data, data, len + 1);
+    size_t size = offsetof(struct launcher_msg, data) + len + 1;
+    return send(s->launcher_fd, &msg, size, MSG_NOSIGNAL | MSG_DONTWAIT) == (ssize_t)size;
+}
+
+static void launcher_setenv(struct server *s, const char *name, const char *value) {
+    char data[LAUNCH_DATA_MAX];
+    snprintf(data, sizeof(data), "%s=%s", name, value);
+    launcher_send(s, LAUNCH_SETENV, 0, data);
+}
+
+static int launcher_event(int fd, uint32_t mask, void *data) {
+    struct server *s = data;
+    struct launcher_msg msg;
+    ssize_t n;
+    while ((n = recv(fd, &msg, sizeof(msg), MSG_DONTWAIT)) > 0) {
+        if (msg.type == LAUNCH_STARTED && msg.pid > 0) {
+            s->children++;
+            TRACE(EV_SPAWNED, msg.id, msg.pid);
+        } else if (msg.type == LAUNCH_STARTED) {
+            TRACE(EV_SPAWN_FAILED, msg.id, msg.status);
+        } else if (msg.type == LAUNCH_EXITED) {
+            s->children--;
+            TRACE(EV_CHILD_EXITED, msg.pid,
+                WIFEXITED(msg.status) ? WEXITSTATUS(msg.status) : -WTERMSIG(msg.status));
+        }
+    }
+    
+    if (n == 0 || (mask & (WL_EVENT_HANGUP | WL_EVENT_ERROR))) {
+        fprintf(stderr, "Launcher exited, commands can no longer be run\n");
+        wl_event_source_remove(s->launcher_source);
+        s->launcher_source = NULL;
+        close(s->launcher_fd);
+        s->launcher_fd = -1;
+    }
+    return 0;
+}
+
+static void exec_command(struct server *s, const char *cmd) {
+    if (!cmd || !cmd[0]) return;
+    uint32_t id = ++s->spawn_serial;
+    if (!launcher_send(s, LAUNCH_EXEC, id, cmd)) {
+        TRACE(EV_SPAWN_FAILED, id, s->launcher_fd < 0 ? ECHILD : EAGAIN);
+    }
+}
+
+/* Layout of the current workspace on the focused output; LAYOUT_COUNT
+ * steps to the next one */
+static void set_layout(struct server *s, int layout) {
+    struct output *o = focused_output(s);
+    if (!o) return;
+    
+    int ws = o->current_ws;
+    if (layout == LAYOUT_COUNT) layout = (o->ws_layout[ws] + 1) % LAYOUT_COUNT;
+    if ((enum layout)layout == o->ws_layout[ws]) return;
+    o->ws_layout[ws] = (enum layout)layout;
+    slot_dirty(o, ws, 0);
+    layout_workspace(o, ws);
+}
+
+/* Next view in layout order on the current workspace, wrapping around */
+static void cycle_focus(struct server *s) {
+    struct wlr_surface *focused = s->seat->keyboard_state.focused_surface;
+    for (int i = 0; i < s->output_count; i++) {
+        struct output *o = s->outputs[i];
+        if (!o) continue;
+        
+        int ws = o->current_ws;
+        int count = o->ws_count[ws];
+        if (count < 2) continue;
+        
+        int next = 0;
+        for (int slot = 0; slot < count; slot++) {
+            if (view_surface(o->workspaces[ws][slot]) == focused) next = (slot + 1) % count;
+        }
+        view_focus(s, o->workspaces[ws][next]);
+        TRACE(EV_FOCUS_CYCLED, o->id);
+    }
+}
+
+/* Command index: built on a worker from $PATH and the XDG applications
+ * directories, one segment per directory. inotify marks segments dirty,
+ * only those are rescanned, and a fresh flat index is handed to the event
+ * loop. The event loop only ever reads a finished index. */
+struct cmd_entry {
+    char *id;                   /* executable name or desktop file name */
+    char *name;                 /* what is matched */
+    char *exec;                 /* what is run */
+};
+
+struct cmd_seg {
+    char dir[PATH_MAX];
+    bool desktop;
+    bool dirty;
+    int wd;
+    struct cmd_entry *entries;
+    int count, cap;
+};
+
+/* Immutable once published; arrays are split so the prefilter streams
+ * through masks alone */
+struct cmd_index {
+    uint32_t count;
+    uint64_t *masks;            /* characters present, see char_bit() */
+    uint32_t *name_off;
+    uint32_t *exec_off;
+    uint16_t *name_len;
+    char *strings;
+    uint32_t *scratch;          /* prefilter survivors, event loop only */
+};
+
+static struct {
+    pthread_t thread;
+    bool started;
+    int pipe[2];                /* worker -> event loop, carries indices */
+    int stop[2];
+    struct cmd_seg segs[CMD_MAX_DIRS];
+    int seg_count;
+} g_cmds = {
+    .pipe = {-1, -1},
+    .stop = {-1, -1},
+};
+
+static int char_bit(unsigned char c) {
+    c = (unsigned char)tolower(c);
+    if (c >= 'a' && c <= 'z') return c - 'a';
+    if (c >= '0' && c <= '9') return 26 + c - '0';
+    return 36 + c % 28;
+}
+
+static uint64_t char_mask(const char *str, size_t len) {
+    uint64_t mask = 0;
+    for (size_t i = 0; i < len; i++) {
+        mask |= 1ULL << char_bit((unsigned char)str[i]);
+    }
+    return mask;
+}
+
+static void cmd_seg_add(struct cmd_seg *seg, const char *id, const char *name, const char *exec) {
+    if (seg->count == seg->cap) {
+        int cap = seg->cap ? seg->cap * 2 : 64;
+        struct cmd_entry *entries = realloc(seg->entries, cap * sizeof(*entries));
+        if (!entries) return;
+        seg->entries = entries;
+        seg->cap = cap;
+    }
+    struct cmd_entry *e = &seg->entries[seg->count];
+    e->id = strdup(id);
+    e->name = strdup(name);
+    e->exec = strdup(exec);
+    if (!e->id || !e->name || !e->exec) {
+        free(e->id);
+        free(e->name);
+        free(e->exec);
+        return;
+    }
+    seg->count++;
+}
+
+static void cmd_seg_clear(struct cmd_seg *seg) {
+    for (int i = 0; i < seg->count; i++) {
+        free(seg->entries[i].id);
+        free(seg->entries[i].name);
+        free(seg->entries[i].exec);
+    }
+    seg->count = 0;
+}
+
+/* Exec= without field codes (%f, %U, ...); "%%" is a literal '%' */
+static void desktop_exec(char *out, size_t size, const char *exec) {
+    size_t n = 0;
+    for (const char *p = exec; *p && n + 1 < size; p++) {
+        if (*p == '%') {
+            if (p[1] == '%') out[n++] = *++p;
+            else if (p[1]) p++;
+            continue;
+        }
+        out[n++] = *p;
+    }
+    while (n > 0 && isspace((unsigned char)out[n - 1])) n--;
+    out[n] = '\0';
+}
+
+static void cmd_scan_desktop(struct cmd_seg *seg, int dfd, const char *file) {
+    int fd = openat(dfd, file, O_RDONLY | O_CLOEXEC);
+    FILE *f = fd >= 0 ? fdopen(fd, "r") : NULL;
+    if (!f) {
+        if (fd >= 0) close(fd);
+        return;
+    }
+    
+    char line[1024], name[256] = "", exec[MAX_CMD_LEN] = "";
+    bool in_entry = false, hidden = false, app = false;
+    while (fgets(line, sizeof(line), f)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '[') {
+            in_entry = strcmp(line, "[Desktop Entry]") == 0;
+        } else if (!in_entry) {
+            continue;
+        } else if (strncmp(line, "Name=", 5) == 0) {
+            snprintf(name, sizeof(name), "%s", line + 5);
+        } else if (strncmp(line, "Exec=", 5) == 0) {
+            desktop_exec(exec, sizeof(exec), line + 5);
+        } else if (strcmp(line, "Type=Application") == 0) {
+            app = true;
+        } else if (strcmp(line, "NoDisplay=true") == 0 || strcmp(line, "Hidden=true") == 0) {
+            hidden = true;
+        }
+    }
+    fclose(f);
+    if (app && !hidden && name[0] && exec[0]) cmd_seg_add(seg, file, name, exec);
+}
+
+static void cmd_scan(struct cmd_seg *seg) {
+    cmd_seg_clear(seg);
+    DIR *d = opendir(seg->dir);
+    if (!d) return;
+    
+    struct dirent *de;
+    while ((de = readdir(d))) {
+        if (de->d_name[0] == '.') continue;
+        if (seg->desktop) {
+            size_t len = strlen(de->d_name);
+            if (len > 8 && strcmp(de->d_name + len - 8, ".desktop") == 0) {
+                cmd_scan_desktop(seg, dirfd(d), de->d_name);
+            }
+        } else {
+            struct stat st;
+            if (fstatat(dirfd(d), de->d_name, &st, 0) == 0 && S_ISREG(st.st_mode) &&
+                    (st.st_mode & 0111)) {
+                cmd_seg_add(seg, de->d_name, de->d_name, de->d_name);
+            }
+        }
+    }
+    closedir(d);
+}
+
+static void cmd_index_free(struct cmd_index *index) {
+    if (!index) return;
+    free(index->masks);
+    free(index->name_off);
+    free(index->exec_off);
+    free(index->name_len);
+    free(index->strings);
+    free(index->scratch);
+    free(index);
+}
+
+/* Flatten segments; the first executable of a name wins, as in $PATH
+ * lookup, and so does the first desktop file of an id */
+static struct cmd_index *cmd_index_build(void) {
+    size_t total = 0, bytes = 0;
+    for (int i = 0; i < g_cmds.seg_count; i++) {
+        struct cmd_seg *seg = &g_cmds.segs[i];
+        total += seg->count;
+        for (int j = 0; j < seg->count; j++) {
+            bytes += strlen(seg->entries[j].name) + strlen(seg->entries[j].exec) + 2;
+        }
+    }
+    
+    size_t buckets = 16;
+    while (buckets < total * 2) buckets *= 2;
+    const struct cmd_entry **seen = calloc(buckets, sizeof(*seen));
+    bool *seen_desktop = calloc(buckets, sizeof(*seen_desktop));
+    struct cmd_index *index = calloc(1, sizeof(*index));
+    if (index) {
+        index->masks = malloc((total + 1) * sizeof(*index->masks));
+        index->name_off = malloc((total + 1) * sizeof(*index->name_off));
+        index->exec_off = malloc((total + 1) * sizeof(*index->exec_off));
+        index->name_len = malloc((total + 1) * sizeof(*index->name_len));
+        index->scratch = malloc((total + 1) * sizeof(*index->scratch));
+        index->strings = malloc(bytes + 1);
+    }
+    if (!seen || !seen_desktop || !index || !index->masks || !index->name_off ||
+            !index->exec_off || !index->name_len || !index->scratch || !index->strings) {
+        free(seen);
+        free(seen_desktop);
+        cmd_index_free(index);
+        return NULL;
+    }
+    
+    size_t pos = 0;
+    for (int i = 0; i < g_cmds.seg_count; i++) {
+        struct cmd_seg *seg = &g_cmds.segs[i];
+        for (int j = 0; j < seg->count; j++) {
+            const struct cmd_entry *e = &seg->entries[j];
+            size_t h = fnv1a(0xcbf29ce484222325ULL, e->id, strlen(e->id)) & (buckets - 1);
+            while (seen[h] && (seen_desktop[h] != seg->desktop || strcmp(seen[h]->id, e->id) != 0)) {
+                h = (h + 1) & (buckets - 1);
+            }
+            if (seen[h]) continue;
+            seen[h] = e;
+            seen_desktop[h] = seg->desktop;
+            
+            uint32_t n = index->count++;
+            size_t name_len = strlen(e->name), exec_len = strlen(e->exec);
+            index->masks[n] = char_mask(e->name, name_len);
+            index->name_len[n] = name_len > UINT16_MAX ? UINT16_MAX : (uint16_t)name_len;
+            index->name_off[n] = (uint32_t)pos;
+            memcpy(index->strings + pos, e->name, name_len + 1);
+            pos += name_len + 1;
+            index->exec_off[n] = (uint32_t)pos;
+            memcpy(index->strings + pos, e->exec, exec_len + 1);
+            pos += exec_len + 1;
+        }
+    }
+    free(seen);
+    free(seen_desktop);
+    return index;
+}
+
+static void cmd_publish(void) {
+    struct cmd_index *index = cmd_index_build();
+    if (index && write(g_cmds.pipe[1], &index, sizeof(index)) != sizeof(index)) {
+        cmd_index_free(index);
+    }
+}
+
+static void cmd_add_dirs(const char *list, const char *suffix, bool desktop, int ifd) {
+    char dirs[4096];
+    snprintf(dirs, sizeof(dirs), "%s", list);
+    for (char *save = NULL, *dir = strtok_r(dirs, ":", &save); dir;
+            dir = strtok_r(NULL, ":", &save)) {
+        if (g_cmds.seg_count == CMD_MAX_DIRS) return;
+        struct cmd_seg *seg = &g_cmds.segs[g_cmds.seg_count++];
+        snprintf(seg->dir, sizeof(seg->dir), "%s%s", dir, suffix);
+        seg->desktop = desktop;
+        seg->wd = inotify_add_watch(ifd, seg->dir, IN_CREATE | IN_DELETE | IN_MOVED_TO |
+            IN_MOVED_FROM | IN_ATTRIB | IN_CLOSE_WRITE | IN_ONLYDIR);
+        cmd_scan(seg);
+    }
+}
+
+/* Directory lists are copied before the thread starts; getenv() would race
+ * with setenv() on the event loop */
+struct cmd_dirs {
+    char path[4096];
+    char data_home[PATH_MAX];
+    char data_dirs[4096];
+};
+
+static void *cmd_thread(void *data) {
+    struct cmd_dirs *dirs = data;
+    int ifd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    cmd_add_dirs(dirs->path, "", false, ifd);
+    cmd_add_dirs(dirs->data_home, "/applications", true, ifd);
+    cmd_add_dirs(dirs->data_dirs, "/applications", true, ifd);
+    free(dirs);
+    cmd_publish();
+    
+    struct pollfd pfds[2] = {
+        { .fd = g_cmds.stop[0], .events = POLLIN },
+        { .fd = ifd, .events = POLLIN },
+    };
+    bool dirty = false;
+    for (;;) {
+        /* Package installs touch many files; wait for them to settle */
+        int ready = poll(pfds, ifd >= 0 ? 2 : 1, dirty ? CMD_RESCAN_DELAY_MS : -1);
+        if (ready < 0) continue;
+        if (pfds[0].revents) break;
+        
+        if (ready == 0) {
+            for (int i = 0; i < g_cmds.seg_count; i++) {
+                if (!g_cmds.segs[i].dirty) continue;
+                g_cmds.segs[i].dirty = false;
+                cmd_scan(&g_cmds.segs[i]);
+            }
+            dirty = false;
+            cmd_publish();
+            continue;
+        }
+        
+        union {
+            struct inotify_event ev;
+            char buf[4096];
+        } u;
+        ssize_t len;
+        while ((len = read(ifd, u.buf, sizeof(u.buf))) > 0) {
+            for (char *p = u.buf; p < u.buf + len; ) {
+                struct inotify_event *ev = (struct inotify_event *)p;
+                for (int i = 0; i < g_cmds.seg_count; i++) {
+                    if (g_cmds.segs[i].wd == ev->wd) g_cmds.segs[i].dirty = dirty = true;
+                }
+                p += sizeof(*ev) + ev->len;
+            }
+        }
+    }
+    
+    for (int i = 0; i < g_cmds.seg_count; i++) {
+        cmd_seg_clear(&g_cmds.segs[i]);
+        free(g_cmds.segs[i].entries);
+    }
+    if (ifd >= 0) close(ifd);
+    return NULL;
+}
+
+/* Fuzzy subsequence score, case-insensitive; -1 if q doesn't match.
+ * Rewards a prefix, word starts and runs, penalises gaps and length. */
+static int fuzzy_score(const char *cand, int len, const char *q, int qlen) {
+    int score = 0, ci = 0, run = 0, first = -1;
+    for (int qi = 0; qi < qlen; qi++) {
+        int qc = tolower((unsigned char)q[qi]);
+        while (ci < len && tolower((unsigned char)cand[ci]) != qc) {
+            ci++;
+            run = 0;
+        }
+        if (ci == len) return -1;
+        if (first < 0) first = ci;
+        
+        score += 16 + run * 8;
+        if (ci == 0 || !isalnum((unsigned char)cand[ci - 1])) score += 12;
+        run++;
+        ci++;
+    }
+    if (first == 0 && run == qlen) score += 64;     /* whole query is a prefix */
+    return score - first * 2 - (len - qlen);
+}
+
+/* Rank the index against the typed text; runs on every cmdbox keystroke */
+static void cmdbox_rank(struct server *s) {
+    struct cmdbox *box = &s->cmdbox;
+    struct cmd_index *index = s->cmd_index;
+    box->match_count = 0;
+    box->selected = 0;
+    if (!index || box->len == 0 || strchr(box->text, ' ')) return;
+    
+    int64_t start = now_ns();
+    
+    /* Branch-free prefilter: every query character must occur */
+    uint64_t qmask = char_mask(box->text, box->len);
+    uint32_t survivors = 0;
+    for (uint32_t i = 0; i < index->count; i++) {
+        index->scratch[survivors] = i;
+        survivors += (index->masks[i] & qmask) == qmask;
+    }
+    
+    int scores[CMDBOX_MATCHES];
+    for (uint32_t k = 0; k < survivors; k++) {
+        uint32_t i = index->scratch[k];
+        int score = fuzzy_score(index->strings + index->name_off[i], index->name_len[i],
+            box->text, box->len);
+        if (score < 0) continue;
+        if (box->match_count == CMDBOX_MATCHES && score <= scores[CMDBOX_MATCHES - 1]) continue;
+        
+        int pos = box->match_count < CMDBOX_MATCHES ? box->match_count++ : CMDBOX_MATCHES - 1;
+        while (pos > 0 && scores[pos - 1] < score) {
+            scores[pos] = scores[pos - 1];
+            box->matches[pos] = box->matches[pos - 1];
+            pos--;
+        }
+        scores[pos] = score;
+        box->matches[pos] = i;
+    }
+    
+    TRACE(EV_CMDBOX_RANK, index->count, survivors, box->match_count, now_ns() - start);
+}
+
+static void cmdbox_complete(struct server *s, int step) {
+    struct cmdbox *box = &s->cmdbox;
+    if (box->match_count == 0) return;
+    if (box->completing) {
+        box->selected = (box->selected + step + box->match_count) % box->match_count;
+    }
+    const char *exec = s->cmd_index->strings + s->cmd_index->exec_off[box->matches[box->selected]];
+    box->len = snprintf(box->text, sizeof(box->text), "%s", exec);
+    if (box->len >= (int)sizeof(box->text)) box->len = sizeof(box->text) - 1;
+    box->completing = true;
+}
+
+static void cmdbox_draw_line(struct server *s, int line, const char *text, bool selected) {
+    struct overlay *ov = s->cmdbox_overlay;
+    int h = g_font.line_height + 2 * OVERLAY_PAD;
+    int len = (int)strlen(text);
+    overlay_fill(ov, 0, line * h, CMDBOX_COLUMNS * g_font.advance + 2 * OVERLAY_PAD, h,
+        !len ? &overlay_clear : selected ? &overlay_accent : &overlay_bg);
+    overlay_text(ov, OVERLAY_PAD, line * h + OVERLAY_PAD + g_font.ascent, text,
+        len < CMDBOX_COLUMNS ? len : CMDBOX_COLUMNS, &overlay_fg);
+}
+
+/* Input line: repaint from the first changed column to the end of the old or
+ * new text, plus the cursor; scrolling repaints the line */
+static void cmdbox_draw_input(struct server *s) {
+    struct overlay *ov = s->cmdbox_overlay;
+    char *drawn = s->cmdbox_drawn[0];
+    char line[sizeof(s->cmdbox_drawn[0])];
+    int len = snprintf(line, sizeof(line), "> %s", s->cmdbox.text);
+    int scroll = len + 1 > CMDBOX_COLUMNS ? len + 1 - CMDBOX_COLUMNS : 0;
+    
+    int old_len = (int)strlen(drawn), from = 0;
+    if (scroll == s->cmdbox_drawn_scroll && old_len > 0) {
+        while (from < len && from < old_len && line[from] == drawn[from]) from++;
+        if (from == len && from == old_len) return;
+    } else {
+        from = scroll;
+        old_len = len;
+        overlay_fill(ov, 0, 0, CMDBOX_COLUMNS * g_font.advance + 2 * OVERLAY_PAD,
+            g_font.line_height + 2 * OVERLAY_PAD, &overlay_bg);
+    }
+    
+    int end = (old_len > len ? old_len : len) + 1;
+    int x = OVERLAY_PAD + (from - scroll) * g_font.advance;
+    overlay_fill(ov, x, OVERLAY_PAD, (end - from) * g_font.advance, g_font.line_height,
+        &overlay_bg);
+    overlay_text(ov, x, OVERLAY_PAD + g_font.ascent, line + from, len - from, &overlay_fg);
+    overlay_fill(ov, OVERLAY_PAD + (len - scroll) * g_font.advance, OVERLAY_PAD, 2,
+        g_font.line_height, &overlay_fg);
+    
+    memcpy(drawn, line, len + 1);
+    s->cmdbox_drawn_scroll = scroll;
+}
+
+static void cmdbox_hide(struct server *s) {
+    if (s->cmdbox_overlay) pointer_rehit(s);
+    overlay_destroy(s->cmdbox_overlay);
+    s->cmdbox_overlay = NULL;
+    s->cmdbox_output = NULL;
+}
+
+/* Show the cmdbox on the focused output and repaint what changed */
+static void cmdbox_redraw(struct server *s) {
+    struct cmdbox *box = &s->cmdbox;
+    if (!box->active) {
+        cmdbox_hide(s);
+        return;
+    }
+    if (!startup_deferred_done(s) || !font_load(s->config.font)) return;
+    
+    if (!s->cmdbox_overlay) {
+        struct output *o = focused_output(s);
+        for (int i = 0; i < s->output_count && !o; i++) o = s->outputs[i];
+        if (!o) return;
+        
+        int width = CMDBOX_COLUMNS * g_font.advance + 2 * OVERLAY_PAD;
+        s->cmdbox_overlay = overlay_create(o->tree, width,
+            CMDBOX_LINES * (g_font.line_height + 2 * OVERLAY_PAD));
+        if (!s->cmdbox_overlay) return;
+        s->cmdbox_output = o;
+        pointer_rehit(s);
+        wlr_scene_node_set_position(&s->cmdbox_overlay->node->node,
+            (o->wlr_output->width - width) / 2, o->wlr_output->height / 4);
+        memset(s->cmdbox_drawn, 0, sizeof(s->cmdbox_drawn));
+        s->cmdbox_drawn_sel = -1;
+        s->cmdbox_drawn_scroll = -1;
+    }
+    
+    cmdbox_draw_input(s);
+    
+    int sel = box->match_count > 0 ? box->selected : -1;
+    for (int i = 0; i < CMDBOX_MATCHES; i++) {
+        const char *name = i < box->match_count && box->matches[i] < s->cmd_index->count ?
+            s->cmd_index->strings + s->cmd_index->name_off[box->matches[i]] : "";
+        char *drawn = s->cmdbox_drawn[1 + i];
+        if (strcmp(name, drawn) == 0 && (i == sel) == (i == s->cmdbox_drawn_sel)) continue;
+        cmdbox_draw_line(s, 1 + i, name, i == sel);
+        snprintf(drawn, sizeof(s->cmdbox_drawn[0]), "%s", name);
+    }
+    s->cmdbox_drawn_sel = sel;
+    overlay_commit(s->cmdbox_overlay);
+}
+
+static int cmd_index_ready(int fd, uint32_t mask, void *data) {
+    struct server *s = data;
+    struct cmd_index *index;
+    if (read(fd, &index, sizeof(index)) != sizeof(index)) return 0;
+    
+    cmd_index_free(s->cmd_index);
+    s->cmd_index = index;
+    TRACE(EV_CMD_INDEX, index->count);
+    
+    /* Matches point into the old index; a completion in progress restarts
+     * from the text it had reached */
+    s->cmdbox.completing = false;
+    if (s->cmdbox.active) {
+        cmdbox_rank(s);
+        cmdbox_redraw(s);
+    } else {
+        s->cmdbox.match_count = 0;
+        s->cmdbox.selected = 0;
+    }
+    return 0;
+}
+
+static void cmd_index_init(struct server *s) {
+    struct cmd_dirs *dirs = calloc(1, sizeof(*dirs));
+    if (!dirs || pipe(g_cmds.pipe) != 0 || pipe(g_cmds.stop) != 0) {
+        free(dirs);
+        return;
+    }
+    for (int i = 0; i < 2; i++) {
+        fcntl(g_cmds.pipe[i], F_SETFD, FD_CLOEXEC);
+        fcntl(g_cmds.stop[i], F_SETFD, FD_CLOEXEC);
+    }
+    
+    const char *home = getenv("HOME");
+    snprintf(dirs->path, sizeof(dirs->path), "%s", env_or("PATH", "/usr/local/bin:/usr/bin:/bin"));
+    if (getenv("XDG_DATA_HOME") && getenv("XDG_DATA_HOME")[0]) {
+        snprintf(dirs->data_home, sizeof(dirs->data_home), "%s", getenv("XDG_DATA_HOME"));
+    } else {
+        snprintf(dirs->data_home, sizeof(dirs->data_home), "%s/.local/share",
+            home ? home : "/");
+    }
+    snprintf(dirs->data_dirs, sizeof(dirs->data_dirs), "%s",
+        env_or("XDG_DATA_DIRS", "/usr/local/share:/usr/share"));
+    
+    wl_event_loop_add_fd(wl_display_get_event_loop(s->display), g_cmds.pipe[0],
+        WL_EVENT_READABLE, cmd_index_ready, s);
+    g_cmds.started = spawn_worker(&g_cmds.thread, cmd_thread, dirs);
+    if (!g_cmds.started) free(dirs);
+}
+
+static void cmd_index_finish(struct server *s) {
+    if (g_cmds.started) {
+        if (write(g_cmds.stop[1], "x", 1) == 1) pthread_join(g_cmds.thread, NULL);
+    }
+    cmd_index_free(s->cmd_index);
+    s->cmd_index = NULL;
+}
+
+static void cmdbox_key(struct server *s, xkb_keysym_t sym) {
+    TRACE(EV_CMDBOX_KEY, sym, s->cmdbox.len);
+    
+    if (sym == XKB_KEY_Tab || sym == XKB_KEY_ISO_Left_Tab) {
+        cmdbox_complete(s, sym == XKB_KEY_Tab ? 1 : -1);
+        cmdbox_redraw(s);
+        return;
+    }
+    
+    if (sym == XKB_KEY_Escape) {
+        s->cmdbox.active = false;
+        s->cmdbox.len = 0;
+        s->cmdbox.text[0] = '\0';
+        TRACE(EV_CMDBOX_CLOSE);
+    } else if (sym == XKB_KEY_Return) {
+        if (s->cmdbox.len > 0) {
+            TRACE(EV_CMDBOX_EXEC, s->cmdbox.len);
+            exec_command(s, s->cmdbox.text);
+        }
+        s->cmdbox.active = false;
+        s->cmdbox.len = 0;
+        s->cmdbox.text[0] = '\0';
+    } else if (sym == XKB_KEY_BackSpace) {
+        if (s->cmdbox.len > 0) {
+            s->cmdbox.len--;
+            s->cmdbox.text[s->cmdbox.len] = '\0';
+        }
+    } else if (sym >= 32 && sym < 127 && s->cmdbox.len < MAX_CMD_LEN - 1) {
+        s->cmdbox.text[s->cmdbox.len++] = (char)sym;
+        s->cmdbox.text[s->cmdbox.len] = '\0';
+    } else {
+        return;
+    }
+    
+    s->cmdbox.completing = false;
+    if (s->cmdbox.active) cmdbox_rank(s);
+    cmdbox_redraw(s);
+}
+
+static void switch_all_workspaces(struct server *s, int ws, int delta) {
+    for (int i = 0; i < s->output_count; i++) {
+        struct output *o = s->outputs[i];
+        if (!o) continue;
+        
+        int new_ws = delta ? o->current_ws + delta : ws;
+        if (new_ws >= 0 && new_ws < s->config.workspaces) {
+            TRACE(EV_WS_SWITCH, o->id, o->current_ws + 1, new_ws + 1);
+            switch_workspace(o, new_ws);
+        } else {
+            TRACE(EV_WS_BOUNDS, o->id, new_ws + 1);
+        }
+    }
+}
+
+static const char *const layout_names[] = {
+#define X(layout, name) [layout] = name,
+    LAYOUTS(X)
+#undef X
+};
+
+static const char *const action_names[] = {
+    [ACTION_NONE] = "none",
+    [ACTION_EXIT] = "exit",
+    [ACTION_WORKSPACE_NEXT] = "workspace-next",
+    [ACTION_WORKSPACE_PREV] = "workspace-prev",
+    [ACTION_WORKSPACE] = "workspace",
+    [ACTION_FOCUS_CYCLE] = "focus-cycle",
+    [ACTION_CMDBOX] = "cmdbox",
+    [ACTION_EXEC] = "exec",
+    [ACTION_LAYOUT] = "layout",
+};
+
+static const struct {
+    const char *name;
+    uint32_t mask;
+} modifier_names[] = {
+    { "shift", WLR_MODIFIER_SHIFT },
+    { "ctrl", WLR_MODIFIER_CTRL },
+    { "control", WLR_MODIFIER_CTRL },
+    { "alt", WLR_MODIFIER_ALT },
+    { "mod1", WLR_MODIFIER_ALT },
+    { "super", WLR_MODIFIER_LOGO },
+    { "logo", WLR_MODIFIER_LOGO },
+    { "mod4", WLR_MODIFIER_LOGO },
+    { "mod3", WLR_MODIFIER_MOD3 },
+    { "mod5", WLR_MODIFIER_MOD5 },
+};
+
+/* A parsed bind line: "Ctrl+Shift+Right workspace-next", "Super+w,1 workspace 1" */
+struct bind_spec {
+    int nkeys;
+    uint32_t mods[BIND_MAX_KEYS];
+    xkb_keysym_t syms[BIND_MAX_KEYS];
+    enum action action;
+    int arg;
+    const char *command;        /* points into the parsed line */
+};
+
+/* "Mod+Mod+keysym"; the keysym is matched case-insensitively */
+static bool parse_combo(const char *combo, size_t len, uint32_t *mods, xkb_keysym_t *sym) {
+    char part[64];
+    *mods = 0;
+    for (;;) {
+        const char *plus = memchr(combo, '+', len);
+        size_t n = plus ? (size_t)(plus - combo) : len;
+        if (n == 0 || n >= sizeof(part)) return false;
+        memcpy(part, combo, n);
+        part[n] = '\0';
+        
+        if (n == len) {
+            *sym = xkb_keysym_to_lower(xkb_keysym_from_name(part, XKB_KEYSYM_CASE_INSENSITIVE));
+            return *sym != XKB_KEY_NoSymbol;
+        }
+        
+        size_t i = 0, count = sizeof(modifier_names) / sizeof(modifier_names[0]);
+        while (i < count && strcasecmp(modifier_names[i].name, part) != 0) i++;
+        if (i == count) return false;
+        *mods |= modifier_names[i].mask;
+        combo += n + 1;
+        len -= n + 1;
+    }
+}
+
+static bool parse_binding(const char *line, struct bind_spec *spec) {
+    memset(spec, 0, sizeof(*spec));
+    const char *p = line;
+    
+    /* Key sequence: combos separated by commas */
+    size_t keys_len = strcspn(p, " \t");
+    for (const char *k = p; k < p + keys_len; ) {
+        size_t n = strcspn(k, ",");
+        if (n > (size_t)(p + keys_len - k)) n = p + keys_len - k;
+        if (spec->nkeys == BIND_MAX_KEYS ||
+                !parse_combo(k, n, &spec->mods[spec->nkeys], &spec->syms[spec->nkeys])) {
+            return false;
+        }
+        spec->nkeys++;
+        k += n + 1;
+    }
+    if (spec->nkeys == 0) return false;
+    
+    p += keys_len;
+    while (isspace((unsigned char)*p)) p++;
+    size_t action_len = strcspn(p, " \t");
+    const char *args = p + action_len;
+    while (isspace((unsigned char)*args)) args++;
+    
+    size_t i = 0, count = sizeof(action_names) / sizeof(action_names[0]);
+    while (i < count && (strlen(action_names[i]) != action_len ||
+            strncmp(action_names[i], p, action_len) != 0)) {
+        i++;
+    }
+    if (i == count) return false;
+    spec->action = (enum action)i;
+    
+    if (spec->action == ACTION_WORKSPACE) {
+        char *end;
+        long n = strtol(args, &end, 10);
+        if (end == args || *end || n < 1 || n > MAX_WORKSPACES) return false;
+        spec->arg = (int)n - 1;
+    } else if (spec->action == ACTION_EXEC) {
+        if (!*args) return false;
+        spec->command = args;
+    } else if (spec->action == ACTION_LAYOUT) {
+        int l = 0;
+        while (l < LAYOUT_COUNT && strcmp(args, layout_names[l]) != 0) l++;
+        if (l == LAYOUT_COUNT && strcmp(args, "next") != 0) return false;
+        spec->arg = l;
+    } else if (*args) {
+        return false;
+    }
+    return true;
+}
+
+static uint64_t binding_key(int mode, uint32_t mods, xkb_keysym_t sym) {
+    return (uint64_t)(mode + 1) << 40 | (uint64_t)(mods & 0xff) << 32 | sym;
+}
+
+static struct binding *binding_slot(struct bindings *b, uint64_t key) {
+    uint32_t i = (uint32_t)((key * 0x9e3779b97f4a7c15ULL) >> 32) & (BIND_TABLE_SIZE - 1);
+    while (b->table[i].key && b->table[i].key != key) {
+        i = (i + 1) & (BIND_TABLE_SIZE - 1);
+    }
+    return &b->table[i];
+}
+
+static const struct binding *binding_lookup(struct bindings *b, int mode,
+        uint32_t mods, xkb_keysym_t sym) {
+    struct binding *e = binding_slot(b, binding_key(mode, mods, sym));
+    return e->key && e->action != ACTION_NONE ? e : NULL;
+}
+
+/* Rebuild the table from config; later lines override earlier ones, so
+ * config binds replace the defaults */
+static void bindings_compile(struct bindings *b, const struct config *c) {
+    memset(b, 0, sizeof(*b));
+    b->mode_count = 1;
+    
+    for (int i = 0; i < c->bind_count; i++) {
+        struct bind_spec spec;
+        if (!parse_binding(c->binds[i], &spec)) continue;
+        
+        int mode = 0;
+        for (int k = 0; k < spec.nkeys; k++) {
+            struct binding *e = binding_slot(b, binding_key(mode, spec.mods[k], spec.syms[k]));
+            if (!e->key && mode == 0) {
+                b->mod_sets[spec.mods[k] >> 5] |= 1u << (spec.mods[k] & 31);
+            }
+            e->key = binding_key(mode, spec.mods[k], spec.syms[k]);
+            
+            if (k + 1 < spec.nkeys) {
+                /* Prefix: reuse the chord's mode, or open a new one */
+                if (e->action != ACTION_CHORD) {
+                    if (b->mode_count == BIND_MAX_MODES) break;
+                    e->action = ACTION_CHORD;
+                    e->arg = b->mode_count++;
+                }
+                mode = e->arg;
+            } else {
+                e->action = spec.action;
+                e->arg = spec.arg;
+                e->command = spec.command;
+            }
+        }
+    }
+}
+
+/* Only modifier combos that start a binding are looked up, so plain typing
+ * goes straight to the client */
+static bool bindings_want(struct server *s, uint32_t mods) {
+    return s->cmdbox.active || s->bind_mode != 0 ||
+        (s->bindings.mod_sets[mods >> 5] & (1u << (mods & 31)));
+}
+
+static const struct binding *key_match(struct server *s, uint32_t mods,
+        const xkb_keysym_t *syms, int nsyms) {
+    for (int i = 0; i < nsyms; i++) {
+        const struct binding *b = binding_lookup(&s->bindings, s->bind_mode, mods,
+            xkb_keysym_to_lower(syms[i]));
+        if (b) return b;
+    }
+    return NULL;
+}
+
+static void binding_run(struct server *s, const struct binding *b) {
+    TRACE(EV_BINDING, b->action, s->bind_mode);
+    s->bind_mode = 0;
+    
+    switch (b->action) {
+        case ACTION_NONE:
+            break;
+        case ACTION_EXIT:
+            TRACE(EV_EXIT);
+            wl_display_terminate(s->display);
+            s->running = false;
+            break;
+        case ACTION_WORKSPACE_NEXT:
+            switch_all_workspaces(s, 0, 1);
+            break;
+        case ACTION_WORKSPACE_PREV:
+            switch_all_workspaces(s, 0, -1);
+            break;
+        case ACTION_WORKSPACE:
+            switch_all_workspaces(s, b->arg, 0);
+            break;
+        case ACTION_FOCUS_CYCLE:
+            cycle_focus(s);
+            break;
+        case ACTION_CMDBOX:
+            s->cmdbox.active = true;
+            s->cmdbox.len = 0;
+            s->cmdbox.text[0] = '\0';
+            s->cmdbox.match_count = 0;
+            s->cmdbox.completing = false;
+            cmdbox_redraw(s);
+            TRACE(EV_CMDBOX_OPEN);
+            break;
+        case ACTION_EXEC:
+            exec_command(s, b->command);
+            break;
+        case ACTION_LAYOUT:
+            set_layout(s, b->arg);
+            break;
+        case ACTION_CHORD:
+            s->bind_mode = b->arg;
+            break;
+    }
+}
+
+/* Returns true if the press was used by the compositor */
+static bool handle_key(struct server *s, struct keyboard *kb, uint32_t keycode, uint32_t mods) {
+    const xkb_keysym_t *syms;
+    int nsyms = xkb_state_key_get_syms(kb->wlr_keyboard->xkb_state, keycode + 8, &syms);
+    
+    if (s->cmdbox.active) {
+        for (int i = 0; i < nsyms; i++) {
+            cmdbox_key(s, syms[i]);
+        }
+        return true;
+    }
+    
+    const struct binding *b = key_match(s, mods, syms, nsyms);
+    if (b) {
+        binding_run(s, b);
+        return true;
+    }
+    
+    /* An unbound key ends a chord and is swallowed; modifiers don't count */
+    if (s->bind_mode != 0) {
+        for (int i = 0; i < nsyms; i++) {
+            if ((syms[i] >= XKB_KEY_Shift_L && syms[i] <= XKB_KEY_Hyper_R) ||
+                    syms[i] == XKB_KEY_ISO_Level3_Shift) {
+                return false;
+            }
+        }
+        TRACE(EV_CHORD_CANCEL, s->bind_mode);
+        s->bind_mode = 0;
+        return true;
+    }
+    return false;
+}
+
+static void kb_modifiers(struct wl_listener *listener, void *data) {
+    struct keyboard *kb = wl_container_of(listener, kb, modifiers);
+    wlr_seat_set_keyboard(kb->server->seat, kb->wlr_keyboard);
+    wlr_seat_keyboard_notify_modifiers(kb->server->seat, &kb->wlr_keyboard->modifiers);
+}
+
+static void kb_key(struct wl_listener *listener, void *data) {
+    struct keyboard *kb = wl_container_of(listener, kb, key);
+    struct wlr_keyboard_key_event *event = data;
+    
+    uint32_t code = event->keycode;
+    uint32_t bit = 1u << (code & 31);
+    bool tracked = code < sizeof(kb->consumed) * 8;
+    input_stamp(kb->server);
+    record_emit(REC_KEY, event->state, code, 0, 0, 0, 0);
+    
+    if (event->state == WL_KEYBOARD_KEY_STATE_PRESSED && kb->wlr_keyboard->keymap) {
+        uint32_t mods = wlr_keyboard_get_modifiers(kb->wlr_keyboard) & ~BIND_IGNORED_MODS;
+        if (bindings_want(kb->server, mods) && handle_key(kb->server, kb, code, mods)) {
+            if (tracked) kb->consumed[code >> 5] |= bit;
+            return;
+        }
+    } else if (tracked && (kb->consumed[code >> 5] & bit)) {
+        kb->consumed[code >> 5] &= ~bit;
+        return;
+    }
+    
+    wlr_seat_set_keyboard(kb->server->seat, kb->wlr_keyboard);
+    wlr_seat_keyboard_notify_key(kb->server->seat, event->time_msec,
+        event->keycode, event->state);
+}
+
+/* RMLVO and the xkeyboard-config root, copied out of the environment on
+ * the event loop so the compile itself can run on any thread */
+struct keymap_names {
+    char rules[64], model[64], layout[256], variant[256], options[256];
+    char root[PATH_MAX];
+};
+
+static void keymap_names_get(struct keymap_names *n) {
+    snprintf(n->rules, sizeof(n->rules), "%s", env_or("XKB_DEFAULT_RULES", "evdev"));
+    snprintf(n->model, sizeof(n->model), "%s", env_or("XKB_DEFAULT_MODEL", "pc105"));
+    snprintf(n->layout, sizeof(n->layout), "%s", env_or("XKB_DEFAULT_LAYOUT", "us"));
+    snprintf(n->variant, sizeof(n->variant), "%s", env_or("XKB_DEFAULT_VARIANT", ""));
+    snprintf(n->options, sizeof(n->options), "%s", env_or("XKB_DEFAULT_OPTIONS", ""));
+    snprintf(n->root, sizeof(n->root), "%s", env_or("XKB_CONFIG_ROOT", XKB_CONFIG_ROOT));
+}
+
+/* RMLVO plus the identity of the xkeyboard-config data it resolves
+ * against; a package upgrade replaces the rules file and so the key.
+ * Returns false if the data can't be found, which disables the disk cache. */
+static bool keymap_key(const struct keymap_names *names, char *out, size_t size) {
+    char path[PATH_MAX];
+    struct stat rules, symbols;
+    snprintf(path, sizeof(path), "%s/rules/%s", names->root, names->rules);
+    bool found = stat(path, &rules) == 0;
+    snprintf(path, sizeof(path), "%s/symbols", names->root);
+    found = found && stat(path, &symbols) == 0;
+    
+    snprintf(out, size, "%s|%s|%s|%s|%s|%s|%lld:%lld|%lld", names->rules, names->model,
+        names->layout, names->variant, names->options, names->root,
+        found ? (long long)rules.st_mtime : 0LL, found ? (long long)rules.st_size : 0LL,
+        found ? (long long)symbols.st_mtime : 0LL);
+    return found;
+}
+
+/* Cache file: the key on the first line, then the serialized keymap */
+static struct xkb_keymap *keymap_cache_load(struct xkb_context *ctx, const char *file,
+        const char *key) {
+    FILE *f = fopen(file, "rb");
+    if (!f) return NULL;
+    
+    struct stat st;
+    char *buf = NULL;
+    size_t len = 0;
+    if (fstat(fileno(f), &st) == 0 && st.st_size > 0) {
+        len = (size_t)st.st_size;
+        buf = malloc(len + 1);
+    }
+    if (!buf || fread(buf, 1, len, f) != len) {
+        free(buf);
+        fclose(f);
+        return NULL;
+    }
+    fclose(f);
+    buf[len] = '\0';
+    
+    struct xkb_keymap *keymap = NULL;
+    char *text = strchr(buf, '\n');
+    if (text && (size_t)(text - buf) == strlen(key) && memcmp(buf, key, text - buf) == 0) {
+        keymap = xkb_keymap_new_from_string(ctx, text + 1, XKB_KEYMAP_FORMAT_TEXT_V1,
+            XKB_KEYMAP_COMPILE_NO_FLAGS);
+    }
+    free(buf);
+    return keymap;
+}
+
+static void keymap_cache_store(struct xkb_keymap *keymap, const char *dir,
+        const char *file, const char *key) {
+    char *text = xkb_keymap_get_as_string(keymap, XKB_KEYMAP_FORMAT_TEXT_V1);
+    if (!text) return;
+    
+    char tmp[PATH_MAX];
+    snprintf(tmp, sizeof(tmp), "%s.%d.tmp", file, (int)getpid());
+    mkdir(dir, 0700);
+    FILE *f = fopen(tmp, "wb");
+    if (f) {
+        bool ok = fprintf(f, "%s\n", key) > 0 && fputs(text, f) >= 0;
+        ok = fclose(f) == 0 && ok;
+        if (!ok || rename(tmp, file) != 0) unlink(tmp);
+    }
+    free(text);
+}
+
+/* Compiling from RMLVO walks dozens of include files; the disk cache keeps
+ * that to once per settings change and data upgrade. Touches nothing but
+ * ctx, so the startup worker uses it as well. */
+static struct xkb_keymap *keymap_compile(struct xkb_context *ctx,
+        const struct keymap_names *n, const char *key, bool cacheable) {
+    struct xkb_rule_names names = {
+        .rules = n->rules,
+        .model = n->model,
+        .layout = n->layout,
+        .variant = n->variant,
+        .options = n->options,
+    };
+    
+    int64_t start = now_ns();
+    char dir[PATH_MAX], file[PATH_MAX + 32];
+    cache_dir(dir, sizeof(dir));
+    snprintf(file, sizeof(file), "%s/keymap-%016llx.xkb", dir,
+        (unsigned long long)fnv1a(0xcbf29ce484222325ULL, key, strlen(key)));
+    
+    struct xkb_keymap *keymap = cacheable ? keymap_cache_load(ctx, file, key) : NULL;
+    bool from_cache = keymap != NULL;
+    if (!keymap) {
+        keymap = xkb_keymap_new_from_names(ctx, &names, XKB_KEYMAP_COMPILE_NO_FLAGS);
+        if (!keymap) return NULL;
+        if (cacheable) keymap_cache_store(keymap, dir, file, key);
+    }
+    TRACE(EV_KEYMAP_LOADED, from_cache, (now_ns() - start) / 1000);
+    return keymap;
+}
+
+/* One keymap shared by every keyboard until the settings change */
+static struct xkb_keymap *keymap_get(struct server *s) {
+    struct keymap_names names;
+    keymap_names_get(&names);
+    char key[sizeof(s->keymap_key)];
+    bool cacheable = keymap_key(&names, key, sizeof(key));
+    if (s->keymap && strcmp(key, s->keymap_key) == 0) return s->keymap;
+    
+    if (!s->xkb_context) s->xkb_context = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
+    if (!s->xkb_context) return NULL;
+    
+    struct xkb_keymap *keymap = keymap_compile(s->xkb_context, &names, key, cacheable);
+    if (!keymap) return NULL;
+    if (s->keymap) xkb_keymap_unref(s->keymap);
+    s->keymap = keymap;
+    snprintf(s->keymap_key, sizeof(s->keymap_key), "%s", key);
+    return keymap;
+}
+
+/* Keyboards that show up during startup get the keymap when the worker
+ * delivers it; until then keys reach the seat without bindings */
+static void new_keyboard(struct server *s, struct wlr_input_device *device) {
+    if (s->keyboard_count >= MAX_KEYBOARDS) return;
+    
+    struct wlr_keyboard *wlr_kb = wlr_keyboard_from_input_device(device);
+    struct keyboard *kb = calloc(1, sizeof(*kb));
+    kb->server = s;
+    kb->wlr_keyboard = wlr_kb;
+    
+    struct xkb_keymap *keymap = startup_deferred_done(s) ? keymap_get(s) : NULL;
+    if (keymap) wlr_keyboard_set_keymap(wlr_kb, keymap);
+    wlr_keyboard_set_repeat_info(wlr_kb, 25, 600);
+    
+    kb->modifiers.notify = kb_modifiers;
+    wl_signal_add(&wlr_kb->events.modifiers, &kb->modifiers);
+    kb->key.notify = kb_key;
+    wl_signal_add(&wlr_kb->events.key, &kb->key);
+    
+    wlr_seat_set_keyboard(s->seat, wlr_kb);
+    s->keyboards[s->keyboard_count++] = kb;
+    
+    TRACE(EV_KEYBOARD_ADDED, s->keyboard_count);
+}
+
+/* Startup work that doesn't touch wlroots state: keymap compile, cursor
+ * theme and font. The worker starts before the backend does, so it runs
+ * alongside device discovery and the first modeset; the event loop adopts
+ * all of it at once. Image decode and the PATH scan have their own
+ * workers already (bg_thread, cmd_thread). */
+static struct {
+    pthread_t thread;
+    bool started;
+    int pipe[2];                /* worker -> event loop, one byte when done */
+    struct wl_event_source *source;
+    
+    /* Copied before the thread starts; getenv() would race with setenv() */
+    struct keymap_names names;
+    char font[256];
+    
+    struct xkb_context *xkb_context;
+    struct xkb_keymap *keymap;
+    char keymap_key[1024];
+    struct wlr_xcursor_manager *cursor_mgr;
+} g_prep = {
+    .pipe = {-1, -1},
+};
+
+static void *prep_thread(void *data) {
+    bool cacheable = keymap_key(&g_prep.names, g_prep.keymap_key, sizeof(g_prep.keymap_key));
+    g_prep.xkb_context = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
+    if (g_prep.xkb_context) {
+        g_prep.keymap = keymap_compile(g_prep.xkb_context, &g_prep.names,
+            g_prep.keymap_key, cacheable);
+    }
+    
+    /* Scale 1 covers most outputs; others load lazily on first use */
+    g_prep.cursor_mgr = wlr_xcursor_manager_create(NULL, 24);
+    if (g_prep.cursor_mgr) wlr_xcursor_manager_load(g_prep.cursor_mgr, 1);
+    
+    font_load(g_prep.font);
+    
+    /* Nobody listens when this ran inline; the write just fails */
+    char done = 1;
+    ssize_t n = write(g_prep.pipe[1], &done, 1);
+    (void)n;
+    return NULL;
+}
+
+static void prep_adopt(struct server *s) {
+    if (g_prep.started) {
+        pthread_join(g_prep.thread, NULL);
+        g_prep.started = false;
+    }
+    
+    if (!s->xkb_context) {
+        s->xkb_context = g_prep.xkb_context;
+    } else if (g_prep.xkb_context) {
+        xkb_context_unref(g_prep.xkb_context);
+    }
+    if (g_prep.keymap && !s->keymap) {
+        s->keymap = g_prep.keymap;
+        snprintf(s->keymap_key, sizeof(s->keymap_key), "%s", g_prep.keymap_key);
+    } else if (g_prep.keymap) {
+        xkb_keymap_unref(g_prep.keymap);
+    }
+    g_prep.xkb_context = NULL;
+    g_prep.keymap = NULL;
+    
+    s->cursor_mgr = g_prep.cursor_mgr;
+    g_prep.cursor_mgr = NULL;
+    if (s->cursor_mgr && !s->seat->pointer_state.focused_surface) {
+        wlr_cursor_set_xcursor(s->cursor, s->cursor_mgr, "default");
+    }
+    
+    /* A reload may have picked another font while the worker loaded this one */
+    if (strcmp(g_prep.font, s->config.font) != 0) font_unload();
+    
+    startup_mark(s, PHASE_DEFERRED);
+    for (int i = 0; i < s->keyboard_count; i++) {
+        struct xkb_keymap *keymap = keymap_get(s);
+        if (keymap) wlr_keyboard_set_keymap(s->keyboards[i]->wlr_keyboard, keymap);
+    }
+    for (int i = 0; i < s->output_count; i++) {
+        if (s->outputs[i]) indicator_update(s->outputs[i]);
+    }
+}
+
+static int prep_done(int fd, uint32_t mask, void *data) {
+    struct server *s = data;
+    char done;
+    ssize_t n = read(fd, &done, 1);
+    (void)n;
+    wl_event_source_remove(g_prep.source);
+    g_prep.source = NULL;
+    prep_adopt(s);
+    return 0;
+}
+
+/* Runs the work inline if no thread can be had */
+static void prep_start(struct server *s) {
+    keymap_names_get(&g_prep.names);
+    snprintf(g_prep.font, sizeof(g_prep.font), "%s", s->config.font);
+    
+    if (pipe(g_prep.pipe) == 0) {
+        fcntl(g_prep.pipe[0], F_SETFD, FD_CLOEXEC);
+        fcntl(g_prep.pipe[1], F_SETFD, FD_CLOEXEC);
+        g_prep.source = wl_event_loop_add_fd(wl_display_get_event_loop(s->display),
+            g_prep.pipe[0], WL_EVENT_READABLE, prep_done, s);
+        g_prep.started = g_prep.source && spawn_worker(&g_prep.thread, prep_thread, NULL);
+    }
+    if (!g_prep.started) {
+        if (g_prep.source) wl_event_source_remove(g_prep.source);
+        g_prep.source = NULL;
+        prep_thread(NULL);
+        prep_adopt(s);
+    }
+}
+
+/* Exit before the worker finished: wait for it, then drop what it made */
+static void prep_finish(void) {
+    if (g_prep.source) wl_event_source_remove(g_prep.source);
+    if (g_prep.started) pthread_join(g_prep.thread, NULL);
+    if (g_prep.keymap) xkb_keymap_unref(g_prep.keymap);
+    if (g_prep.xkb_context) xkb_context_unref(g_prep.xkb_context);
+    if (g_prep.cursor_mgr) wlr_xcursor_manager_destroy(g_prep.cursor_mgr);
+    for (int i = 0; i < 2; i++) {
+        if (g_prep.pipe[i] >= 0) close(g_prep.pipe[i]);
+    }
+}
+
+/* The cursor image moves right away; clients hear about it on the next flush */
+static void process_cursor_motion(struct server *s, uint32_t time,
+        double dx, double dy, double dx_unaccel, double dy_unaccel) {
+    input_stamp(s);
+    s->pointer_time = time;
+    s->pointer_dx += dx;
+    s->pointer_dy += dy;
+    s->pointer_dx_unaccel += dx_unaccel;
+    s->pointer_dy_unaccel += dy_unaccel;
+    s->pointer_events++;
+    pointer_schedule(s);
+}
+
+static void cursor_motion(struct wl_listener *listener, void *data) {
+    struct server *s = wl_container_of(listener, s, cursor_motion);
+    struct wlr_pointer_motion_event *event = data;
+    record_emit(REC_MOTION, 0, 0, event->delta_x, event->delta_y,
+        event->unaccel_dx, event->unaccel_dy);
+    wlr_cursor_move(s->cursor, &event->pointer->base, event->delta_x, event->delta_y);
+    process_cursor_motion(s, event->time_msec, event->delta_x, event->delta_y,
+        event->unaccel_dx, event->unaccel_dy);
+}
+
+static void cursor_motion_absolute(struct wl_listener *listener, void *data) {
+    struct server *s = wl_container_of(listener, s, cursor_motion_absolute);
+    struct wlr_pointer_motion_absolute_event *event = data;
+    record_emit(REC_MOTION_ABSOLUTE, 0, 0, event->x, event->y, 0, 0);
+    double x = s->cursor->x, y = s->cursor->y;
+    wlr_cursor_warp_absolute(s->cursor, &event->pointer->base, event->x, event->y);
+    double dx = s->cursor->x - x, dy = s->cursor->y - y;
+    process_cursor_motion(s, event->time_msec, dx, dy, dx, dy);
+}
+
+/* Buttons and scrolling go to where the pointer is now */
+static void cursor_button(struct wl_listener *listener, void *data) {
+    struct server *s = wl_container_of(listener, s, cursor_button);
+    struct wlr_pointer_button_event *event = data;
+    record_emit(REC_BUTTON, event->state, event->button, 0, 0, 0, 0);
+    input_stamp(s);
+    pointer_flush(s);
+    wlr_seat_pointer_notify_button(s->seat, event->time_msec, event->button, event->state);
+}
+
+static void cursor_axis(struct wl_listener *listener, void *data) {
+    struct server *s = wl_container_of(listener, s, cursor_axis);
+    struct wlr_pointer_axis_event *event = data;
+    record_emit(REC_AXIS, event->orientation | event->source << 4 | event->relative_direction << 8,
+        event->delta_discrete, event->delta, 0, 0, 0);
+    input_stamp(s);
+    pointer_flush(s);
+    wlr_seat_pointer_notify_axis(s->seat, event->time_msec,
+        event->orientation, event->delta, event->delta_discrete, event->source,
+        event->relative_direction);
+}
+
+static void cursor_frame(struct wl_listener *listener, void *data) {
+    struct server *s = wl_container_of(listener, s, cursor_frame);
+    record_emit(REC_FRAME, 0, 0, 0, 0, 0, 0);
+    /* Pending motion gets its frame when it is flushed */
+    if (!s->pointer_pending) wlr_seat_pointer_notify_frame(s->seat);
+}
+
+static void request_cursor(struct wl_listener *listener, void *data) {
+    struct server *s = wl_container_of(listener, s, request_cursor);
+    struct wlr_seat_pointer_request_set_cursor_event *event = data;
+    if (s->seat->pointer_state.focused_client == event->seat_client) {
+        wlr_cursor_set_surface(s->cursor, event->surface, event->hotspot_x, event->hotspot_y);
+    }
+}
+
+static void request_set_selection(struct wl_listener *listener, void *data) {
+    struct server *s = wl_container_of(listener, s, request_set_selection);
+    struct wlr_seat_request_set_selection_event *event = data;
+    wlr_seat_set_selection(s->seat, event->source, event->serial);
+}
+
+static void new_pointer(struct server *s, struct wlr_input_device *device) {
+    wlr_cursor_attach_input_device(s->cursor, device);
+}
+
+static void new_input(struct wl_listener *listener, void *data) {
+    struct server *s = wl_container_of(listener, s, new_input);
+    struct wlr_input_device *device = data;
+    
+    switch (device->type) {
+        case WLR_INPUT_DEVICE_KEYBOARD:
+            new_keyboard(s, device);
+            break;
+        case WLR_INPUT_DEVICE_POINTER:
+            new_pointer(s, device);
+            break;
+        default:
+            break;
+    }
+    
+    wlr_seat_set_capabilities(s->seat, WL_SEAT_CAPABILITY_POINTER | WL_SEAT_CAPABILITY_KEYBOARD);
+}
+
+static void view_map(struct wl_listener *listener, void *data) {
+    struct view *view = wl_container_of(listener, view, map);
+    view->mapped = true;
+    record_emit(REC_VIEW_MAPPED, 0, view->index, 0, 0, 0, 0);
+    replay_view_mapped(1);
+    
+    struct output *output;
+    int ws, slot;
+    
+    if (find_space(view->server, &output, &ws, &slot)) {
+        view->output = output;
+        view->workspace = ws;
+        view->ws_slot = slot;
+        slot_take(output, ws, slot, view);
+        
+        /* Stays hidden until its first correctly sized buffer arrives */
+        wlr_scene_node_reparent(&view->scene_tree->node, output->ws_trees[ws]);
+        wlr_scene_node_set_enabled(&view->scene_tree->node, false);
+        layout_workspace(output, ws);
+        view_focus(view->server, view);
+        pointer_rehit(view->server);
+        
+        TRACE(EV_VIEW_MAPPED, output->id, ws + 1, slot);
+        ipc_event(view->server, IPC_EVENT_VIEW, "event map %u:%u %s %d %s",
+            view->index, view->generation, output->wlr_output->name, ws + 1,
+            view_app_id(view) ? view_app_id(view) : "-");
+    } else {
+        wlr_scene_node_set_enabled(&view->scene_tree->node, false);
+        TRACE(EV_VIEW_NO_SPACE);
+        ipc_event(view->server, IPC_EVENT_VIEW, "event map %u:%u - 0 %s",
+            view->index, view->generation,
+            view_app_id(view) ? view_app_id(view) : "-");
+    }
+    ipc_changed(view->server);
+}
+
+/* Give a mapped view without a workspace a free slot; stays hidden if none */
+static bool view_place(struct server *s, struct view *v) {
+    struct output *o;
+    int ws, slot;
+    if (!find_space(s, &o, &ws, &slot)) return false;
+    v->output = o;
+    v->workspace = ws;
+    v->ws_slot = slot;
+    slot_take(o, ws, slot, v);
+    
+    /* Hidden until its transaction applies, unless it already fits the slot */
+    wlr_scene_node_reparent(&v->scene_tree->node, o->ws_trees[ws]);
+    wlr_scene_node_set_enabled(&v->scene_tree->node, false);
+    layout_workspace(o, ws);
+    if (!v->in_txn) wlr_scene_node_set_enabled(&v->scene_tree->node, true);
+    pointer_rehit(s);
+    ipc_changed(s);
+    return true;
+}
+
+/* Mapped views without a workspace get the first free slots; the rest
+ * wait for space */
+static void views_place_waiting(struct server *s) {
+    for (uint32_t i = 0; i < s->views.live_count; i++) {
+        struct view *v = view_at(&s->views, s->views.live[i]);
+        if (v->mapped && !v->output && !view_place(s, v)) {
+            TRACE(EV_VIEW_NO_SPACE);
+        }
+    }
+}
+
+/* A disabled output keeps its state but can't show anything: its views
+ * move to the enabled outputs, as when it is unplugged */
+static void output_evacuate(struct output *o) {
+    struct server *s = o->server;
+    for (int ws = 0; ws < MAX_WORKSPACES; ws++) {
+        for (int slot = o->ws_count[ws] - 1; slot >= 0; slot--) {
+            struct view *v = o->workspaces[ws][slot];
+            txn_remove(o, v);
+            slot_release(o, ws, slot);
+            wlr_scene_node_reparent(&v->scene_tree->node, &s->scene->tree);
+            wlr_scene_node_set_enabled(&v->scene_tree->node, false);
+            v->output = NULL;
+        }
+    }
+    views_place_waiting(s);
+    pointer_rehit(s);
+    ipc_changed(s);
+}
+
+static void view_unmap(struct wl_listener *listener, void *data) {
+    struct view *view = wl_container_of(listener, view, unmap);
+    view->mapped = false;
+    record_emit(REC_VIEW_UNMAPPED, 0, view->index, 0, 0, 0, 0);
+    replay_view_mapped(-1);
+    
+    /* A remapped toplevel starts over with a fresh initial configure */
+    view->width = view->height = 0;
+    pointer_rehit(view->server);
+    
+    if (view->output) {
+        struct output *o = view->output;
+        txn_remove(o, view);
+        slot_release(o, view->workspace, view->ws_slot);
+        layout_workspace(o, view->workspace);
+        view->output = NULL;
+        
+        /* Focus falls back to the neighbour on the same workspace */
+        struct server *s = view->server;
+        if (view_get(&s->views, s->focused) == view) {
+            view_focus(s, slot_neighbour(o, view->workspace, view->ws_slot));
+        }
+    }
+    ipc_event(view->server, IPC_EVENT_VIEW, "event unmap %u:%u",
+        view->index, view->generation);
+    ipc_changed(view->server);
+}
+
+static void view_commit(struct wl_listener *listener, void *data) {
+    struct view *view = wl_container_of(listener, view, commit);
+    
+    /* wlroots leaves the initial configure to the compositor */
+    if (view->xdg_toplevel->base->initial_commit) {
+        wlr_xdg_toplevel_set_size(view->xdg_toplevel, 0, 0);
+        return;
+    }
+    
+    /* Size or subsurfaces may have changed under a cached hit */
+    if (view->server->hit_surface == view->xdg_toplevel->base->surface) {
+        view->server->hit_surface = NULL;
+    }
+    
+    /* Serial comparison is wrap-safe */
+    uint32_t acked = view->xdg_toplevel->base->current.configure_serial;
+    if (view->txn_waiting && (int32_t)(acked - view->txn_serial) >= 0) {
+        view->txn_waiting = false;
+        if (--view->output->txn_waiting == 0) txn_apply(view->output);
+    }
+}
+
+static void view_destroy(struct wl_listener *listener, void *data) {
+    struct view *view = wl_container_of(listener, view, destroy);
+    
+    wl_list_remove(&view->map.link);
+    wl_list_remove(&view->unmap.link);
+    wl_list_remove(&view->commit.link);
+    wl_list_remove(&view->destroy.link);
+    
+    view_free(&view->server->views, view);
+}
+
+static void new_xdg_surface(struct wl_listener *listener, void *data) {
+    struct server *s = wl_container_of(listener, s, new_xdg_surface);
+    struct wlr_xdg_surface *xdg_surface = data;
+    
+    if (xdg_surface->role != WLR_XDG_SURFACE_ROLE_TOPLEVEL) return;
+    
+    struct view *view = view_alloc(&s->views);
+    if (!view) return;
+    view->server = s;
+    view->xdg_toplevel = xdg_surface->toplevel;
+    view->scene_tree = wlr_scene_xdg_surface_create(&s->scene->tree, xdg_surface);
+    
+    view->map.notify = view_map;
+    wl_signal_add(&xdg_surface->surface->events.map, &view->map);
+    view->unmap.notify = view_unmap;
+    wl_signal_add(&xdg_surface->surface->events.unmap, &view->unmap);
+    view->commit.notify = view_commit;
+    wl_signal_add(&xdg_surface->surface->events.commit, &view->commit);
+    view->destroy.notify = view_destroy;
+    wl_signal_add(&xdg_surface->events.destroy, &view->destroy);
+}
+
+#if WLR_HAS_XWAYLAND
+/* X11 windows. Managed ones are views like any other and take the same
+ * slots; they get a scene tree when mapped, since the wl_surface comes and
+ * goes with the X window's association. Override-redirect windows (menus,
+ * tooltips) place themselves and sit above everything. */
+struct unmanaged {
+    struct wlr_xwayland_surface *xsurface;
+    struct wlr_scene_tree *scene_tree;
+    struct wl_listener associate;
+    struct wl_listener dissociate;
+    struct wl_listener map;
+    struct wl_listener unmap;
+    struct wl_listener set_geometry;
+    struct wl_listener destroy;
+};
+
+static void xwayland_map(struct wl_listener *listener, void *data) {
+    struct view *view = wl_container_of(listener, view, map);
+    struct server *s = view->server;
+    view->scene_tree = wlr_scene_subsurface_tree_create(&s->scene->tree, view->xsurface->surface);
+    if (!view->scene_tree) return;
+    view->width = view->height = 0;
+    view_map(listener, data);
+}
+
+static void xwayland_unmap(struct wl_listener *listener, void *data) {
+    struct view *view = wl_container_of(listener, view, unmap);
+    if (!view->scene_tree) return;
+    view_unmap(listener, data);
+    wlr_scene_node_destroy(&view->scene_tree->node);
+    view->scene_tree = NULL;
+}
+
+static void xwayland_associate(struct wl_listener *listener, void *data) {
+    struct view *view = wl_container_of(listener, view, associate);
+    struct wlr_surface *surface = view->xsurface->surface;
+    view->map.notify = xwayland_map;
+    wl_signal_add(&surface->events.map, &view->map);
+    view->unmap.notify = xwayland_unmap;
+    wl_signal_add(&surface->events.unmap, &view->unmap);
+}
+
+static void xwayland_dissociate(struct wl_listener *listener, void *data) {
+    struct view *view = wl_container_of(listener, view, dissociate);
+    wl_list_remove(&view->map.link);
+    wl_list_remove(&view->unmap.link);
+}
+
+/* Tiled windows get their slot's geometry back; the rest get what they ask */
+static void xwayland_request_configure(struct wl_listener *listener, void *data) {
+    struct view *view = wl_container_of(listener, view, request_configure);
+    struct wlr_xwayland_surface_configure_event *event = data;
+    int lx, ly;
+    if (view->output && view->scene_tree &&
+            wlr_scene_node_coords(&view->scene_tree->node, &lx, &ly)) {
+        wlr_xwayland_surface_configure(view->xsurface, lx, ly, view->width, view->height);
+    } else {
+        wlr_xwayland_surface_configure(view->xsurface, event->x, event->y,
+            event->width, event->height);
+    }
+}
+
+static void xwayland_destroy(struct wl_listener *listener, void *data) {
+    struct view *view = wl_container_of(listener, view, destroy);
+    wl_list_remove(&view->associate.link);
+    wl_list_remove(&view->dissociate.link);
+    wl_list_remove(&view->request_configure.link);
+    wl_list_remove(&view->destroy.link);
+    view_free(&view->server->views, view);
+}
+
+static void unmanaged_map(struct wl_listener *listener, void *data) {
+    struct unmanaged *u = wl_container_of(listener, u, map);
+    struct server *s = u->xsurface->data;
+    u->scene_tree = wlr_scene_subsurface_tree_create(s->unmanaged, u->xsurface->surface);
+    if (!u->scene_tree) return;
+    wlr_scene_node_set_position(&u->scene_tree->node, u->xsurface->x, u->xsurface->y);
+    wlr_scene_node_raise_to_top(&s->unmanaged->node);
+    if (wlr_xwayland_or_surface_wants_focus(u->xsurface)) {
+        wlr_seat_keyboard_notify_enter(s->seat, u->xsurface->surface, NULL, 0, NULL);
+    }
+    pointer_rehit(s);
+}
+
+static void unmanaged_unmap(struct wl_listener *listener, void *data) {
+    struct unmanaged *u = wl_container_of(listener, u, unmap);
+    struct server *s = u->xsurface->data;
+    if (!u->scene_tree) return;
+    wlr_scene_node_destroy(&u->scene_tree->node);
+    u->scene_tree = NULL;
+    
+    /* A menu that took the keyboard hands it back to the focused view */
+    if (s->seat->keyboard_state.focused_surface == u->xsurface->surface) {
+        struct view *v = view_get(&s->views, s->focused);
+        if (v && v->mapped) {
+            wlr_seat_keyboard_notify_enter(s->seat, view_surface(v), NULL, 0, NULL);
+        } else {
+            wlr_seat_keyboard_clear_focus(s->seat);
+        }
+    }
+    pointer_rehit(s);
+}
+
+static void unmanaged_set_geometry(struct wl_listener *listener, void *data) {
+    struct unmanaged *u = wl_container_of(listener, u, set_geometry);
+    if (u->scene_tree) {
+        wlr_scene_node_set_position(&u->scene_tree->node, u->xsurface->x, u->xsurface->y);
+        pointer_rehit(u->xsurface->data);
+    }
+}
+
+static void unmanaged_associate(struct wl_listener *listener, void *data) {
+    struct unmanaged *u = wl_container_of(listener, u, associate);
+    u->map.notify = unmanaged_map;
+    wl_signal_add(&u->xsurface->surface->events.map, &u->map);
+    u->unmap.notify = unmanaged_unmap;
+    wl_signal_add(&u->xsurface->surface->events.unmap, &u->unmap);
+}
+
+static void unmanaged_dissociate(struct wl_listener *listener, void *data) {
+    struct unmanaged *u = wl_container_of(listener, u, dissociate);
+    wl_list_remove(&u->map.link);
+    wl_list_remove(&u->unmap.link);
+}
+
+static void unmanaged_destroy(struct wl_listener *listener, void *data) {
+    struct unmanaged *u = wl_container_of(listener, u, destroy);
+    wl_list_remove(&u->associate.link);
+    wl_list_remove(&u->dissociate.link);
+    wl_list_remove(&u->set_geometry.link);
+    wl_list_remove(&u->destroy.link);
+    free(u);
+}
+
+static void new_xwayland_surface(struct wl_listener *listener, void *data) {
+    struct server *s = wl_container_of(listener, s, new_xwayland_surface);
+    struct wlr_xwayland_surface *xsurface = data;
+    
+    if (xsurface->override_redirect) {
+        struct unmanaged *u = calloc(1, sizeof(*u));
+        if (!u) return;
+        u->xsurface = xsurface;
+        xsurface->data = s;
+        u->associate.notify = unmanaged_associate;
+        wl_signal_add(&xsurface->events.associate, &u->associate);
+        u->dissociate.notify = unmanaged_dissociate;
+        wl_signal_add(&xsurface->events.dissociate, &u->dissociate);
+        u->set_geometry.notify = unmanaged_set_geometry;
+        wl_signal_add(&xsurface->events.set_geometry, &u->set_geometry);
+        u->destroy.notify = unmanaged_destroy;
+        wl_signal_add(&xsurface->events.destroy, &u->destroy);
+        return;
+    }
+    
+    struct view *view = view_alloc(&s->views);
+    if (!view) return;
+    view->server = s;
+    view->xsurface = xsurface;
+    view->associate.notify = xwayland_associate;
+    wl_signal_add(&xsurface->events.associate, &view->associate);
+    view->dissociate.notify = xwayland_dissociate;
+    wl_signal_add(&xsurface->events.dissociate, &view->dissociate);
+    view->request_configure.notify = xwayland_request_configure;
+    wl_signal_add(&xsurface->events.request_configure, &view->request_configure);
+    view->destroy.notify = xwayland_destroy;
+    wl_signal_add(&xsurface->events.destroy, &view->destroy);
+}
+
+/* Runs each time Xwayland (re)starts on a connection */
+static void xwayland_ready(struct wl_listener *listener, void *data) {
+    struct server *s = wl_container_of(listener, s, xwayland_ready);
+    wlr_xwayland_set_seat(s->xwayland, s->seat);
+    
+    struct wlr_xcursor *cursor = s->cursor_mgr ?
+        wlr_xcursor_manager_get_xcursor(s->cursor_mgr, "default", 1) : NULL;
+    if (cursor) {
+        struct wlr_xcursor_image *image = cursor->images[0];
+        wlr_xwayland_set_cursor(s->xwayland, image->buffer, image->width * 4,
+            image->width, image->height, image->hotspot_x, image->hotspot_y);
+    }
+}
+
+/* Reserves the X display and exports DISPLAY; nothing runs until a client
+ * connects. Xwayland exits xwayland_idle seconds after the last X client
+ * and the socket goes back to waiting. wlroots takes the delay only at
+ * creation, so a reloaded value needs a restart. */
+static void xwayland_init(struct server *s) {
+    struct wlr_xwayland_server_options options = {
+        .lazy = true,
+        .enable_wm = true,
+        .terminate_delay = s->config.xwayland_idle,
+    };
+    struct wlr_xwayland_server *server = wlr_xwayland_server_create(s->display, &options);
+    if (server) s->xwayland = wlr_xwayland_create_with_server(s->display, s->compositor, server);
+    if (!s->xwayland) {
+        if (server) wlr_xwayland_server_destroy(server);
+        fprintf(stderr, "Xwayland: unavailable, X11 clients won't run\n");
+        return;
+    }
+    
+    s->unmanaged = wlr_scene_tree_create(&s->scene->tree);
+    s->xwayland_ready.notify = xwayland_ready;
+    wl_signal_add(&s->xwayland->events.ready, &s->xwayland_ready);
+    s->new_xwayland_surface.notify = new_xwayland_surface;
+    wl_signal_add(&s->xwayland->events.new_surface, &s->new_xwayland_surface);
+    
+    setenv("DISPLAY", s->xwayland->display_name, 1);
+    launcher_setenv(s, "DISPLAY", s->xwayland->display_name);
+}
+
+static void xwayland_finish(struct server *s) {
+    if (!s->xwayland) return;
+    wl_list_remove(&s->xwayland_ready.link);
+    wl_list_remove(&s->new_xwayland_surface.link);
+    struct wlr_xwayland_server *server = s->xwayland->server;
+    wlr_xwayland_destroy(s->xwayland);
+    wlr_xwayland_server_destroy(server);
+    s->xwayland = NULL;
+}
+#endif
+
+/* Config file: $XDG_CONFIG_HOME/eldinwm/eldinwm.conf */
+static void config_path(char *out, size_t size) {
+    const char *xdg = getenv("XDG_CONFIG_HOME");
+    if (xdg && xdg[0]) {
+        snprintf(out, size, "%s/eldinwm/eldinwm.conf", xdg);
+        return;
+    }
+    const char *home = getenv("HOME");
+    if (!home) {
+        struct passwd *pw = getpwuid(getuid());
+        home = pw ? pw->pw_dir : "/";
+    }
+    snprintf(out, size, "%s/.config/eldinwm/eldinwm.conf", home);
+}
+
+enum config_type {
+    CONFIG_INT,
+    CONFIG_STRING,
+    CONFIG_ENUM,
+    CONFIG_BIND,                /* repeatable, appends to config.binds */
+};
+
+static const char *const tearing_names[] = {
+    [TEARING_NEVER] = "never",
+    [TEARING_FULLSCREEN] = "fullscreen",
+};
+
+static const char *const hidden_views_names[] = {
+    [HIDDEN_KEEP] = "keep",
+    [HIDDEN_SUSPEND] = "suspend",
+    [HIDDEN_SHRINK] = "shrink",
+};
+
+static const char *const memory_pressure_names[] = {
+    [PRESSURE_IGNORE] = "ignore",
+    [PRESSURE_SHRINK] = "shrink",
+};
+
+static const char *const placement_names[] = {
+    [PLACE_FIRST_FREE] = "first-free",
+    [PLACE_CURRENT_WS] = "current-workspace",
+    [PLACE_FOCUSED_OUTPUT] = "focused-output",
+    [PLACE_LEAST_LOADED] = "least-loaded",
+};
+
+/* Recognised keys; min/max bound integers and enum indices into names,
+ * strings are limited by their field */
+static const struct config_key {
+    const char *name;
+    enum config_type type;
+    size_t offset;
+    size_t size;
+    int min, max;
+    const char *const *names;
+} config_keys[] = {
+    { "workspaces", CONFIG_INT, offsetof(struct config, workspaces),
+        0, 1, MAX_WORKSPACES, NULL },
+    { "max_render_time", CONFIG_INT, offsetof(struct config, max_render_time),
+        0, 0, 1000, NULL },
+    { "background_image", CONFIG_STRING, offsetof(struct config, background_image),
+        sizeof(((struct config *)0)->background_image), 0, 0, NULL },
+    { "font", CONFIG_STRING, offsetof(struct config, font),
+        sizeof(((struct config *)0)->font), 0, 0, NULL },
+    { "placement", CONFIG_ENUM, offsetof(struct config, placement),
+        0, 0, PLACE_LEAST_LOADED, placement_names },
+    { "layout", CONFIG_ENUM, offsetof(struct config, layout),
+        0, 0, LAYOUT_COUNT - 1, layout_names },
+    { "views_per_workspace", CONFIG_INT, offsetof(struct config, views_per_workspace),
+        0, 1, MAX_VIEWS_PER_WS, NULL },
+    { "hidden_views", CONFIG_ENUM, offsetof(struct config, hidden_views),
+        0, 0, HIDDEN_SHRINK, hidden_views_names },
+    { "memory_pressure", CONFIG_ENUM, offsetof(struct config, memory_pressure),
+        0, 0, PRESSURE_SHRINK, memory_pressure_names },
+    { "xwayland_idle", CONFIG_INT, offsetof(struct config, xwayland_idle),
+        0, 0, 86400, NULL },
+    { "tearing", CONFIG_ENUM, offsetof(struct config, tearing),
+        0, 0, TEARING_FULLSCREEN, tearing_names },
+    { "bind", CONFIG_BIND, 0, 0, 0, 0, NULL },
+};
+
+/* Config bind lines come after these, so they can override them */
+static const char *const default_binds[] = {
+    "Ctrl+Shift+Down exit",
+    "Ctrl+Shift+Left workspace-prev",
+    "Ctrl+Shift+Right workspace-next",
+    "Ctrl+Shift+z cmdbox",
+    "Ctrl+Shift+x focus-cycle",
+};
+
+static void config_defaults(struct config *c) {
+    memset(c, 0, sizeof(*c));
+    c->workspaces = 4;
+    c->views_per_workspace = 2;
+    c->tearing = TEARING_FULLSCREEN;
+    c->xwayland_idle = 30;
+    c->hidden_views = HIDDEN_SUSPEND;
+    c->memory_pressure = PRESSURE_SHRINK;
+    snprintf(c->font, sizeof(c->font), "%s", "monospace:pixelsize=16");
+    for (size_t i = 0; i < sizeof(default_binds) / sizeof(default_binds[0]); i++) {
+        snprintf(c->binds[c->bind_count++], MAX_BIND_LEN, "%s", default_binds[i]);
+    }
+}
+
+static bool config_set(struct config *c, const struct config_key *key, const char *value) {
+    char *field = (char *)c + key->offset;
+    if (key->type == CONFIG_BIND) {
+        struct bind_spec spec;
+        if (c->bind_count == MAX_BINDINGS || strlen(value) >= MAX_BIND_LEN ||
+                !parse_binding(value, &spec)) {
+            return false;
+        }
+        memcpy(c->binds[c->bind_count++], value, strlen(value) + 1);
+        return true;
+    }
+    if (key->type == CONFIG_STRING) {
+        if (strlen(value) >= key->size) return false;
+        memcpy(field, value, strlen(value) + 1);
+        return true;
+    }
+    if (key->type == CONFIG_ENUM) {
+        for (int i = key->min; i <= key->max; i++) {
+            if (strcmp(key->names[i], value) == 0) {
+                *(int *)field = i;
+                return true;
+            }
+        }
+        return false;
+    }
+    
+    char *end;
+    long n = strtol(value, &end, 10);
+    if (end == value || *end || n < key->min || n > key->max) return false;
+    *(int *)field = (int)n;
+    return true;
+}
+
+/* "key = value" lines, value optionally quoted, '#' starts a comment.
+ * Returns the number of errors; callers reject a file that has any. */
+static int config_load(const char *path, struct config *c) {
+    config_defaults(c);
+    FILE *f = fopen(path, "r");
+    if (!f) return 0;
+    
+    char line[PATH_MAX + 64];
+    int lineno = 0, errors = 0;
+    while (fgets(line, sizeof(line), f)) {
+        lineno++;
+        
+        /* Cut the comment, but not a '#' inside quotes */
+        bool quoted = false;
+        for (char *p = line; *p; p++) {
+            if (*p == '"') quoted = !quoted;
+            if (*p == '#' && !quoted) {
+                *p = '\0';
+                break;
+            }
+        }
+        
+        char *p = line;
+        while (isspace((unsigned char)*p)) p++;
+        if (!*p) continue;
+        
+        char *eq = strchr(p, '=');
+        if (!eq) {
+            fprintf(stderr, "Config %s:%d: expected key = value\n", path, lineno);
+            errors++;
+            continue;
+        }
+        char *name_end = eq;
+        while (name_end > p && isspace((unsigned char)name_end[-1])) name_end--;
+        *name_end = '\0';
+        
+        char *value = eq + 1;
+        while (isspace((unsigned char)*value)) value++;
+        char *end = value + strlen(value);
+        while (end > value && isspace((unsigned char)end[-1])) end--;
+        if (end - value >= 2 && *value == '"' && end[-1] == '"') {
+            value++;
+            end--;
+        }
+        *end = '\0';
+        
+        const struct config_key *key = NULL;
+        for (size_t i = 0; i < sizeof(config_keys) / sizeof(config_keys[0]); i++) {
+            if (strcmp(config_keys[i].name, p) == 0) key = &config_keys[i];
+        }
+        if (!key) {
+            fprintf(stderr, "Config %s:%d: unknown key '%s'\n", path, lineno, p);
+            errors++;
+        } else if (!config_set(c, key, value)) {
+            fprintf(stderr, "Config %s:%d: bad value '%s' for %s\n",
+                path, lineno, value, key->name);
+            errors++;
+        }
+    }
+    fclose(f);
+    return errors;
+}
+
+/* Background images: decoded and cover-scaled on a worker thread, cached
+ * on disk per (path, mtime, size, resolution) and mmapped from there */
+struct bg_cache_header {
+    char magic[8];
+    uint32_t width, height, stride;
+    uint32_t pad;
+    int64_t mtime;
+    int64_t size;
+};
+
+struct bg_job {
+    struct bg_job *next;
+    uint32_t generation;
+    char path[PATH_MAX];
+    int width, height;
+    
+    /* Filled by the worker */
+    void *map;                  /* mmapped cache file, or NULL */
+    size_t map_size;
+    uint32_t *pixels;           /* into map, or malloc'd if the cache is unwritable */
+    int stride;
+};
+
+/* A read-only pixel buffer shared by every output with this resolution.
+ * It is uploaded once: the scene reuses a client buffer's texture. */
+struct bg_buffer {
+    struct wlr_buffer base;
+    struct wlr_client_buffer *texture;  /* what outputs attach, NULL if upload failed */
+    void *map;
+    size_t map_size;
+    uint32_t *pixels;
+    int stride;
+};
+
+static struct {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    struct bg_job *queue;
+    bool started;
+    bool stop;
+    int pipe[2];                /* worker -> event loop, carries finished jobs */
+} g_bg = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+    .pipe = {-1, -1},
+};
+
+/* Map a cache file if it matches; no decoding involved */
+static bool bg_cache_load(struct bg_job *job, const char *file, const struct stat *src) {
+    int fd = open(file, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    
+    size_t expect = sizeof(struct bg_cache_header) + (size_t)job->width * job->height * 4;
+    struct stat st;
+    void *map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size == expect) {
+        map = mmap(NULL, expect, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (map == MAP_FAILED) return false;
+    
+    const struct bg_cache_header *h = map;
+    if (memcmp(h->magic, "ELDBG001", 8) != 0 || (int)h->width != job->width ||
+            (int)h->height != job->height || h->mtime != (int64_t)src->st_mtime ||
+            h->size != (int64_t)src->st_size) {
+        munmap(map, expect);
+        return false;
+    }
+    
+    job->map = map;
+    job->map_size = expect;
+    job->pixels = (uint32_t *)(h + 1);
+    job->stride = (int)h->stride;
+    return true;
+}
+
+/* Decode a PNG and scale it to cover width x height, cropping the overflow */
+static uint32_t *bg_decode_cover(const char *path, int width, int height) {
+    png_image png = { .version = PNG_IMAGE_VERSION };
+    if (!png_image_begin_read_from_file(&png, path)) return NULL;
+    png.format = PNG_FORMAT_BGRA;
+    
+    uint32_t *src = malloc(PNG_IMAGE_SIZE(png));
+    if (!src || !png_image_finish_read(&png, NULL, src, 0, NULL)) {
+        png_image_free(&png);
+        free(src);
+        return NULL;
+    }
+    
+    uint32_t *dst = malloc((size_t)width * height * 4);
+    if (!dst) {
+        free(src);
+        return NULL;
+    }
+    
+    int sw = (int)png.width, sh = (int)png.height;
+    double fx = (double)width / sw, fy = (double)height / sh;
+    double f = fx > fy ? fx : fy;
+    
+    pixman_image_t *src_img = pixman_image_create_bits(PIXMAN_x8r8g8b8, sw, sh, src, sw * 4);
+    pixman_image_t *dst_img = pixman_image_create_bits(PIXMAN_x8r8g8b8, width, height, dst, width * 4);
+    pixman_transform_t transform;
+    pixman_transform_init_scale(&transform, pixman_double_to_fixed(1.0 / f),
+        pixman_double_to_fixed(1.0 / f));
+    pixman_image_set_transform(src_img, &transform);
+    pixman_image_set_filter(src_img, PIXMAN_FILTER_GOOD, NULL, 0);
+    
+    /* Source offsets are in destination space, before the transform */
+    int crop_x = (int)((sw * f - width) / 2);
+    int crop_y = (int)((sh * f - height) / 2);
+    pixman_image_composite32(PIXMAN_OP_SRC, src_img, NULL, dst_img,
+        crop_x, crop_y, 0, 0, 0, 0, width, height);
+    
+    pixman_image_unref(src_img);
+    pixman_image_unref(dst_img);
+    free(src);
+    return dst;
+}
+
+/* Write to a temp file and rename, so readers never see a partial cache */
+static bool bg_cache_store(const char *file, const struct bg_cache_header *h, const uint32_t *pixels) {
+    char tmp[PATH_MAX];
+    snprintf(tmp, sizeof(tmp), "%s.%d.tmp", file, (int)getpid());
+    FILE *f = fopen(tmp, "wb");
+    if (!f) return false;
+    
+    size_t len = (size_t)h->width * h->height * 4;
+    bool ok = fwrite(h, sizeof(*h), 1, f) == 1 && fwrite(pixels, 1, len, f) == len;
+    ok = fclose(f) == 0 && ok;
+    if (!ok || rename(tmp, file) != 0) {
+        unlink(tmp);
+        return false;
+    }
+    return true;
+}
+
+static void bg_job_run(struct bg_job *job) {
+    struct stat st;
+    if (stat(job->path, &st) != 0) return;
+    
+    uint64_t key = fnv1a(0xcbf29ce484222325ULL, job->path, strlen(job->path));
+    int64_t fields[4] = { st.st_mtime, st.st_size, job->width, job->height };
+    key = fnv1a(key, fields, sizeof(fields));
+    
+    char dir[PATH_MAX], file[PATH_MAX + 32];
+    cache_dir(dir, sizeof(dir));
+    snprintf(file, sizeof(file), "%s/bg-%016llx.raw", dir, (unsigned long long)key);
+    if (bg_cache_load(job, file, &st)) return;
+    
+    uint32_t *pixels = bg_decode_cover(job->path, job->width, job->height);
+    if (!pixels) return;
+    
+    struct bg_cache_header h = {
+        .magic = "ELDBG001",
+        .width = job->width, .height = job->height, .stride = job->width * 4,
+        .mtime = st.st_mtime, .size = st.st_size,
+    };
+    mkdir(dir, 0700);
+    if (bg_cache_store(file, &h, pixels) && bg_cache_load(job, file, &st)) {
+        free(pixels);
+        return;
+    }
+    job->pixels = pixels;
+    job->stride = job->width * 4;
+}
+
+static void *bg_thread(void *data) {
+    pthread_mutex_lock(&g_bg.lock);
+    while (!g_bg.stop) {
+        struct bg_job *job = g_bg.queue;
+        if (!job) {
+            pthread_cond_wait(&g_bg.cond, &g_bg.lock);
+            continue;
+        }
+        g_bg.queue = job->next;
+        pthread_mutex_unlock(&g_bg.lock);
+        
+        bg_job_run(job);
+        if (write(g_bg.pipe[1], &job, sizeof(job)) != sizeof(job)) {
+            free(job);
+        }
+        
+        pthread_mutex_lock(&g_bg.lock);
+    }
+    pthread_mutex_unlock(&g_bg.lock);
+    return NULL;
+}
+
+static void bg_buffer_destroy(struct wlr_buffer *wlr_buffer) {
+    struct bg_buffer *buf = wl_container_of(wlr_buffer, buf, base);
+    if (buf->map) {
+        munmap(buf->map, buf->map_size);
+    } else {
+        free(buf->pixels);
+    }
+    free(buf);
+}
+
+static bool bg_buffer_begin_access(struct wlr_buffer *wlr_buffer, uint32_t flags,
+        void **data, uint32_t *format, size_t *stride) {
+    struct bg_buffer *buf = wl_container_of(wlr_buffer, buf, base);
+    if (flags & WLR_BUFFER_DATA_PTR_ACCESS_WRITE) return false;
+    *data = buf->pixels;
+    *format = DRM_FORMAT_XRGB8888;
+    *stride = buf->stride;
+    return true;
+}
+
+static void bg_buffer_end_access(struct wlr_buffer *wlr_buffer) {
+}
+
+static const struct wlr_buffer_impl bg_buffer_impl = {
+    .destroy = bg_buffer_destroy,
+    .begin_data_ptr_access = bg_buffer_begin_access,
+    .end_data_ptr_access = bg_buffer_end_access,
+};
+
+static void bg_attach(struct output *output, struct bg_buffer *buf) {
+    if (!buf) {
+        if (output->bg_node) {
+            wlr_scene_node_destroy(&output->bg_node->node);
+            output->bg_node = NULL;
+        }
+        return;
+    }
+    struct wlr_buffer *shown = buf->texture ? &buf->texture->base : &buf->base;
+    if (output->bg_node) {
+        wlr_scene_buffer_set_buffer(output->bg_node, shown);
+    } else {
+        output->bg_node = wlr_scene_buffer_create(output->tree, shown);
+        wlr_scene_node_lower_to_bottom(&output->bg_node->node);
+    }
+}
+
+static struct bg_buffer *bg_lookup(struct server *s, int width, int height) {
+    for (int i = 0; i < s->bg_count; i++) {
+        struct bg_buffer *buf = s->bg_buffers[i];
+        if (buf->base.width == width && buf->base.height == height) return buf;
+    }
+    return NULL;
+}
+
+/* Attach a cached buffer or queue a job; never blocks on I/O */
+static void bg_request(struct output *output) {
+    struct server *s = output->server;
+    int width = output->wlr_output->width;
+    int height = output->wlr_output->height;
+    if (!s->config.background_image[0] || width <= 0 || height <= 0) {
+        bg_attach(output, NULL);
+        return;
+    }
+    
+    struct bg_buffer *buf = bg_lookup(s, width, height);
+    if (buf) {
+        bg_attach(output, buf);
+        return;
+    }
+    
+    for (int i = 0; i < s->bg_pending_count; i++) {
+        if (s->bg_pending[i].width == width && s->bg_pending[i].height == height) return;
+    }
+    if (s->bg_pending_count >= MAX_OUTPUTS) return;
+    
+    struct bg_job *job = calloc(1, sizeof(*job));
+    if (!job) return;
+    job->generation = s->bg_generation;
+    snprintf(job->path, sizeof(job->path), "%s", s->config.background_image);
+    job->width = width;
+    job->height = height;
+    s->bg_pending[s->bg_pending_count].width = width;
+    s->bg_pending[s->bg_pending_count].height = height;
+    s->bg_pending_count++;
+    
+    pthread_mutex_lock(&g_bg.lock);
+    if (!g_bg.started) {
+        g_bg.started = spawn_worker(&g_bg.thread, bg_thread, NULL);
+    }
+    job->next = g_bg.queue;
+    g_bg.queue = job;
+    pthread_cond_signal(&g_bg.cond);
+    pthread_mutex_unlock(&g_bg.lock);
+}
+
+static void bg_job_free(struct bg_job *job) {
+    if (job->map) {
+        munmap(job->map, job->map_size);
+    } else {
+        free(job->pixels);
+    }
+    free(job);
+}
+
+/* The client buffer comes back locked and already dropped */
+static void bg_buffer_drop(struct bg_buffer *buf) {
+    if (buf->texture) wlr_buffer_unlock(&buf->texture->base);
+    wlr_buffer_drop(&buf->base);
+}
+
+/* Forget buffers no output can use any more; scene nodes keep their own locks */
+static void bg_prune(struct server *s) {
+    for (int i = 0; i < s->bg_count; i++) {
+        struct bg_buffer *buf = s->bg_buffers[i];
+        bool used = false;
+        for (int j = 0; j < s->output_count && !used; j++) {
+            struct output *o = s->outputs[j];
+            used = o && o->wlr_output->width == buf->base.width &&
+                o->wlr_output->height == buf->base.height;
+        }
+        if (!used) {
+            bg_buffer_drop(buf);
+            s->bg_buffers[i--] = s->bg_buffers[--s->bg_count];
+        }
+    }
+}
+
+static int bg_job_done(int fd, uint32_t mask, void *data) {
+    struct server *s = data;
+    struct bg_job *job;
+    if (read(fd, &job, sizeof(job)) != sizeof(job)) return 0;
+    
+    /* The background changed while this job was running */
+    if (job->generation != s->bg_generation) {
+        bg_job_free(job);
+        return 0;
+    }
+    
+    for (int i = 0; i < s->bg_pending_count; i++) {
+        if (s->bg_pending[i].width == job->width && s->bg_pending[i].height == job->height) {
+            s->bg_pending[i] = s->bg_pending[--s->bg_pending_count];
+            break;
+        }
+    }
+    /* Don't leave a previous image up as if the new one had loaded */
+    if (!job->pixels) {
+        TRACE(EV_BG_FAILED, job->width, job->height);
+        fprintf(stderr, "Background: cannot load %s at %dx%d\n",
+            job->path, job->width, job->height);
+        for (int i = 0; i < s->output_count; i++) {
+            struct output *o = s->outputs[i];
+            if (o && o->wlr_output->width == job->width &&
+                    o->wlr_output->height == job->height) {
+                bg_attach(o, NULL);
+            }
+        }
+        bg_job_free(job);
+        return 0;
+    }
+    
+    bg_prune(s);
+    struct bg_buffer *buf = s->bg_count < MAX_OUTPUTS ? calloc(1, sizeof(*buf)) : NULL;
+    if (!buf) {
+        bg_job_free(job);
+        return 0;
+    }
+    wlr_buffer_init(&buf->base, &bg_buffer_impl, job->width, job->height);
+    buf->map = job->map;
+    buf->map_size = job->map_size;
+    buf->pixels = job->pixels;
+    buf->stride = job->stride;
+    buf->texture = wlr_client_buffer_create(&buf->base, s->renderer);
+    s->bg_buffers[s->bg_count++] = buf;
+    TRACE(EV_BG_READY, job->width, job->height, job->map != NULL);
+    free(job);
+    
+    for (int i = 0; i < s->output_count; i++) {
+        struct output *o = s->outputs[i];
+        if (o && o->wlr_output->width == buf->base.width &&
+                o->wlr_output->height == buf->base.height) {
+            bg_attach(o, buf);
+        }
+    }
+    return 0;
+}
+
+static void bg_init(struct server *s) {
+    if (pipe(g_bg.pipe) != 0) return;
+    fcntl(g_bg.pipe[0], F_SETFD, FD_CLOEXEC);
+    fcntl(g_bg.pipe[1], F_SETFD, FD_CLOEXEC);
+    wl_event_loop_add_fd(wl_display_get_event_loop(s->display), g_bg.pipe[0],
+        WL_EVENT_READABLE, bg_job_done, s);
+}
+
+static void bg_finish(void) {
+    if (!g_bg.started) return;
+    pthread_mutex_lock(&g_bg.lock);
+    g_bg.stop = true;
+    pthread_cond_signal(&g_bg.cond);
+    pthread_mutex_unlock(&g_bg.lock);
+    pthread_join(g_bg.thread, NULL);
+}
+
+/* Time we must reserve before vblank to finish a commit */
+static int64_t output_render_budget(struct output *output) {
+    if (output->server->config.max_render_time > 0) {
+        return output->server->config.max_render_time * NSEC_PER_MSEC;
+    }
+    int64_t budget = output->render_time_ns + RENDER_SLACK_NS;
+    if (output->refresh_ns > 0 && budget > output->refresh_ns) {
+        budget = output->refresh_ns;
+    }
+    return budget;
+}
+
+/* Predict the next vblank and how long we can wait before rendering for it.
+ * Async flips don't wait for vblank, so neither do we. */
+static int64_t output_render_delay(struct output *output, int64_t now) {
+    output->target_vblank_ns = 0;
+    if (output->tearing) return 0;
+    if (output->refresh_ns <= 0 || output->last_present_ns <= 0) return 0;
+    
+    int64_t since = now - output->last_present_ns;
+    int64_t periods = since > 0 ? since / output->refresh_ns + 1 : 1;
+    int64_t next_vblank = output->last_present_ns + periods * output->refresh_ns;
+    output->target_vblank_ns = next_vblank;
+    
+    int64_t delay = next_vblank - output_render_budget(output) - now;
+    return delay > 0 ? delay : 0;
+}
+
+/* Tearing policy: only the sole view on the visible workspace, which the
+ * layout gives the whole output, and only if it asked for async and isn't
+ * video or photo content, which are better served by even pacing */
+static bool output_allows_tearing(struct output *output) {
+    struct server *s = output->server;
+    if (s->config.tearing != TEARING_FULLSCREEN) return false;
+    
+    if (output->ws_count[output->current_ws] != 1) return false;
+    struct view *sole = output->workspaces[output->current_ws][0];
+    if (!sole->mapped || sole->in_txn) return false;
+    
+    struct wlr_surface *surface = view_surface(sole);
+    enum wp_content_type_v1_type content = wlr_surface_get_content_type_v1(s->content_type, surface);
+    return wlr_tearing_control_manager_v1_surface_hint_from_surface(s->tearing_control, surface) ==
+            WP_TEARING_CONTROL_V1_PRESENTATION_HINT_ASYNC &&
+        content != WP_CONTENT_TYPE_V1_TYPE_VIDEO && content != WP_CONTENT_TYPE_V1_TYPE_PHOTO;
+}
+
+/* Falls back to a vsynced flip if the backend can't do this one async */
+static void output_commit_tearing(struct output *output) {
+    struct wlr_output_state state;
+    wlr_output_state_init(&state);
+    if (wlr_scene_output_build_state(output->scene_output, &state, NULL)) {
+        state.tearing_page_flip = true;
+        if (!wlr_output_test_state(output->wlr_output, &state)) state.tearing_page_flip = false;
+        wlr_output_commit_state(output->wlr_output, &state);
+    }
+    wlr_output_state_finish(&state);
+}
+
+static void output_render(struct output *output) {
+    struct wlr_scene_output *scene_output = output->scene_output;
+    output->render_pending = false;
+    
+    if (wlr_scene_output_needs_frame(scene_output)) {
+        bool tearing = output_allows_tearing(output);
+        if (tearing != output->tearing) {
+            output->tearing = tearing;
+            output->target_vblank_ns = 0;
+            TRACE(EV_TEARING, output->id, tearing);
+        }
+        
+        int64_t start = now_ns();
+        if (tearing) {
+            output_commit_tearing(output);
+        } else {
+            wlr_scene_output_commit(scene_output, NULL);
+        }
+        int64_t took = now_ns() - start;
+        
+        /* Fast attack, slow decay */
+        if (took > output->render_time_ns) {
+            output->render_time_ns = took;
+        } else {
+            output->render_time_ns -= (output->render_time_ns - took) / 16;
+        }
+        output->frames_committed++;
+        
+        hist_record(&output->hist_render, took / 1000);
+        output->commit_ns = start + took;
+        if (output->input_ns > 0) {
+            if (output->commit_ns - output->input_ns < INPUT_STALE_NS) {
+                output->commit_input_ns = output->input_ns;
+            }
+            output->input_ns = 0;
+        }
+    } else {
+        /* Nothing changed: no commit, so no further frame event until damage */
+        output->target_vblank_ns = 0;
+        output->frames_skipped++;
+    }
+    
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    wlr_scene_output_send_frame_done(scene_output, &now);
+}
+
+static int output_render_timer(void *data) {
+    output_render(data);
+    return 0;
+}
+
+static void output_frame(struct wl_listener *listener, void *data) {
+    struct output *output = wl_container_of(listener, output, frame);
+    pointer_flush(output->server);
+    if (output->render_pending) return;
+    
+    int64_t delay = output_render_delay(output, now_ns());
+    if (delay < NSEC_PER_MSEC) {
+        output_render(output);
+        return;
+    }
+    
+    output->render_pending = true;
+    wl_event_source_timer_update(output->render_timer, (int)(delay / NSEC_PER_MSEC));
+}
+
+static void output_present(struct wl_listener *listener, void *data) {
+    struct output *output = wl_container_of(listener, output, present);
+    struct wlr_output_event_present *event = data;
+#if WLR_VERSION_NUM >= ((0 << 16) | (19 << 8) | 0)
+    const struct timespec *presented_at = &event->when;
+#else
+    const struct timespec *presented_at = event->when;
+#endif
+    if (!event->presented || !presented_at) return;
+    startup_mark(output->server, PHASE_FIRST_FRAME);
+    
+    int64_t when = timespec_to_ns(presented_at);
+    if (event->refresh > 0) {
+        output->refresh_ns = event->refresh;
+    }
+    
+    /* Landed a full refresh late: we started rendering too close to vblank */
+    int64_t missed = 0;
+    if (output->target_vblank_ns > 0 && output->refresh_ns > 0 &&
+            when > output->target_vblank_ns + output->refresh_ns / 2) {
+        output->deadlines_missed++;
+        TRACE(EV_DEADLINE_MISSED, output->id, when - output->target_vblank_ns);
+        output->render_time_ns += RENDER_SLACK_NS;
+        missed = (when - output->target_vblank_ns + output->refresh_ns / 2) / output->refresh_ns;
+    }
+    
+    if (output->commit_ns > 0 && when >= output->commit_ns) {
+        hist_record(&output->hist_present, (when - output->commit_ns) / 1000);
+        hist_record(&output->hist_missed, missed);
+        if (output->commit_input_ns > 0) {
+            hist_record(&output->hist_input, (when - output->commit_input_ns) / 1000);
+        }
+        output->commit_ns = 0;
+        output->commit_input_ns = 0;
+    }
+    
+    output->last_present_ns = when;
+    output->target_vblank_ns = 0;
+}
+
+/* Outputs: every output that appears in one event loop iteration (all of
+ * them at startup, several on a dock) is modeset in a single backend
+ * commit. Monitors seen before go straight to their last good mode. */
+static void output_key(struct wlr_output *wlr_output, char *out, size_t size) {
+    snprintf(out, size, "%s|%s|%s", wlr_output->make ? wlr_output->make : "",
+        wlr_output->model ? wlr_output->model : "",
+        wlr_output->serial ? wlr_output->serial : "");
+}
+
+static struct known_output *known_output_find(struct server *s, const char *key) {
+    for (int i = 0; i < s->known_count; i++) {
+        if (strcmp(s->known_outputs[i].key, key) == 0) return &s->known_outputs[i];
+    }
+    return NULL;
+}
+
+static void known_outputs_path(char *dir, size_t dir_size, char *file, size_t file_size) {
+    cache_dir(dir, dir_size);
+    snprintf(file, file_size, "%s/outputs", dir);
+}
+
+/* One "width height refresh key" line per monitor */
+static void known_outputs_load(struct server *s) {
+    char dir[PATH_MAX], file[PATH_MAX + 16];
+    known_outputs_path(dir, sizeof(dir), file, sizeof(file));
+    FILE *f = fopen(file, "r");
+    if (!f) return;
+    
+    char line[256];
+    while (s->known_count < MAX_KNOWN_OUTPUTS && fgets(line, sizeof(line), f)) {
+        struct known_output *k = &s->known_outputs[s->known_count];
+        int offset;
+        if (sscanf(line, "%d %d %d %n", &k->width, &k->height, &k->refresh, &offset) != 3) {
+            continue;
+        }
+        line[strcspn(line, "\n")] = '\0';
+        snprintf(k->key, sizeof(k->key), "%s", line + offset);
+        s->known_count++;
+    }
+    fclose(f);
+}
+
+static void known_outputs_store(struct server *s) {
+    char dir[PATH_MAX], file[PATH_MAX + 16], tmp[PATH_MAX + 32];
+    known_outputs_path(dir, sizeof(dir), file, sizeof(file));
+    snprintf(tmp, sizeof(tmp), "%s.%d.tmp", file, (int)getpid());
+    mkdir(dir, 0700);
+    FILE *f = fopen(tmp, "w");
+    if (!f) return;
+    bool ok = true;
+    for (int i = 0; i < s->known_count; i++) {
+        const struct known_output *k = &s->known_outputs[i];
+        ok = fprintf(f, "%d %d %d %s\n", k->width, k->height, k->refresh, k->key) > 0 && ok;
+    }
+    ok = fclose(f) == 0 && ok;
+    if (!ok || rename(tmp, file) != 0) unlink(tmp);
+}
+
+/* Only real modes are remembered; the oldest entry makes room */
+static bool known_output_remember(struct server *s, struct wlr_output *wlr_output) {
+    struct wlr_output_mode *mode = wlr_output->current_mode;
+    if (!mode || !wlr_output->enabled) return false;
+    
+    char key[sizeof(s->known_outputs[0].key)];
+    output_key(wlr_output, key, sizeof(key));
+    struct known_output *k = known_output_find(s, key);
+    if (k && k->width == mode->width && k->height == mode->height &&
+            k->refresh == mode->refresh) {
+        return false;
+    }
+    if (!k) {
+        if (s->known_count == MAX_KNOWN_OUTPUTS) {
+            memmove(&s->known_outputs[0], &s->known_outputs[1],
+                (MAX_KNOWN_OUTPUTS - 1) * sizeof(s->known_outputs[0]));
+            s->known_count--;
+        }
+        k = &s->known_outputs[s->known_count++];
+        snprintf(k->key, sizeof(k->key), "%s", key);
+    }
+    k->width = mode->width;
+    k->height = mode->height;
+    k->refresh = mode->refresh;
+    return true;
+}
+
+static struct wlr_output_mode *known_output_mode(struct server *s, struct wlr_output *wlr_output) {
+    char key[sizeof(s->known_outputs[0].key)];
+    output_key(wlr_output, key, sizeof(key));
+    struct known_output *k = known_output_find(s, key);
+    if (!k) return NULL;
+    
+    struct wlr_output_mode *mode;
+    wl_list_for_each(mode, &wlr_output->modes, link) {
+        if (mode->width == k->width && mode->height == k->height &&
+                mode->refresh == k->refresh) {
+            return mode;
+        }
+    }
+    return NULL;
+}
+
+static int64_t mode_rate(const struct wlr_output_mode *mode) {
+    return (int64_t)mode->width * mode->height * mode->refresh;
+}
+
+/* Next mode down by pixel rate, which is what a shared link runs out of */
+static struct wlr_output_mode *mode_lower(struct wlr_output *wlr_output,
+        const struct wlr_output_mode *than) {
+    struct wlr_output_mode *best = NULL, *mode;
+    wl_list_for_each(mode, &wlr_output->modes, link) {
+        if (mode_rate(mode) < mode_rate(than) && (!best || mode_rate(mode) > mode_rate(best))) {
+            best = mode;
+        }
+    }
+    return best;
+}
+
+static void outputs_configure(void *data) {
+    struct server *s = data;
+    s->outputs_idle = NULL;
+    
+    struct wlr_backend_output_state states[MAX_OUTPUTS];
+    struct wlr_output_mode *modes[MAX_OUTPUTS];
+    int n = 0, cached = 0, fallbacks = 0;
+    for (int i = 0; i < s->output_count; i++) {
+        struct output *o = s->outputs[i];
+        if (!o || o->configured) continue;
+        o->configured = true;
+        
+        struct wlr_output *wlr_output = o->wlr_output;
+        struct wlr_output_state *state = &states[n].base;
+        states[n].output = wlr_output;
+        wlr_output_state_init(state);
+        wlr_output_state_set_enabled(state, true);
+        
+        modes[n] = known_output_mode(s, wlr_output);
+        if (modes[n]) {
+            cached++;
+        } else {
+            modes[n] = wlr_output_preferred_mode(wlr_output);
+        }
+        if (modes[n]) {
+            wlr_output_state_set_mode(state, modes[n]);
+        } else if (wlr_output_is_headless(wlr_output) && s->headless_refresh_mhz > 0) {
+            /* Synthetic refresh rate for testing the frame scheduler */
+            wlr_output_state_set_custom_mode(state, wlr_output->width,
+                wlr_output->height, s->headless_refresh_mhz);
+        }
+        n++;
+    }
+    if (n == 0) return;
+    
+    /* Known-good modes commit without a test; otherwise test and step the
+     * most demanding output down until the whole set fits */
+    bool ok = cached == n && wlr_backend_commit(s->backend, states, n);
+    if (!ok) {
+        while (!wlr_backend_test(s->backend, states, n)) {
+            int worst = -1;
+            for (int i = 0; i < n; i++) {
+                if (modes[i] && mode_lower(states[i].output, modes[i]) &&
+                        (worst < 0 || mode_rate(modes[i]) > mode_rate(modes[worst]))) {
+                    worst = i;
+                }
+            }
+            if (worst < 0) break;
+            modes[worst] = mode_lower(states[worst].output, modes[worst]);
+            wlr_output_state_set_mode(&states[worst].base, modes[worst]);
+            fallbacks++;
+        }
+        ok = wlr_backend_commit(s->backend, states, n);
+    }
+    
+    /* Last resort: whatever each output manages on its own */
+    if (!ok) {
+        fprintf(stderr, "Outputs: batched modeset failed, committing one at a time\n");
+        for (int i = 0; i < n; i++) {
+            wlr_output_commit_state(states[i].output, &states[i].base);
+        }
+    }
+    
+    bool remembered = false;
+    for (int i = 0; i < n; i++) {
+        wlr_output_state_finish(&states[i].base);
+        remembered |= known_output_remember(s, states[i].output);
+    }
+    if (remembered) known_outputs_store(s);
+    TRACE(EV_OUTPUT_MODESET, n, ok, cached, fallbacks);
+}
+
+/* Tell output-management clients (kanshi, wlr-randr) what is current */
+static void output_manager_update(struct server *s) {
+    if (!s->output_manager) return;
+    struct wlr_output_configuration_v1 *config = wlr_output_configuration_v1_create();
+    if (!config) return;
+    for (int i = 0; i < s->output_count; i++) {
+        struct output *o = s->outputs[i];
+        if (!o) continue;
+        struct wlr_output_configuration_head_v1 *head =
+            wlr_output_configuration_head_v1_create(config, o->wlr_output);
+        struct wlr_output_layout_output *l_output =
+            wlr_output_layout_get(s->output_layout, o->wlr_output);
+        if (head && l_output) {
+            head->state.x = l_output->x;
+            head->state.y = l_output->y;
+        }
+    }
+    wlr_output_manager_v1_set_configuration(s->output_manager, config);
+}
+
+/* Runtime changes go through the same single backend commit */
+static bool output_config_apply(struct server *s, struct wlr_output_configuration_v1 *config,
+        bool test_only) {
+    size_t n;
+    struct wlr_backend_output_state *states = wlr_output_configuration_v1_build_state(config, &n);
+    if (!states) return false;
+    bool ok = test_only ? wlr_backend_test(s->backend, states, n) :
+        wlr_backend_commit(s->backend, states, n);
+    for (size_t i = 0; i < n; i++) {
+        wlr_output_state_finish(&states[i].base);
+    }
+    free(states);
+    if (!ok || test_only) return ok;
+    
+    bool remembered = false;
+    struct wlr_output_configuration_head_v1 *head;
+    wl_list_for_each(head, &config->heads, link) {
+        struct wlr_output *wlr_output = head->state.output;
+        if (head->state.enabled) {
+            struct wlr_output_layout_output *l_output = wlr_output_layout_add(
+                s->output_layout, wlr_output, head->state.x, head->state.y);
+            
+            /* Removing it from the layout dropped its scene output's link */
+            for (int i = 0; i < s->output_count && l_output; i++) {
+                struct output *o = s->outputs[i];
+                if (o && o->wlr_output == wlr_output) {
+                    wlr_scene_output_layout_add_output(s->scene_layout, l_output, o->scene_output);
+                }
+            }
+            remembered |= known_output_remember(s, wlr_output);
+        } else {
+            /* Its views moved off in output_commit */
+            wlr_output_layout_remove(s->output_layout, wlr_output);
+        }
+    }
+    if (remembered) known_outputs_store(s);
+    return true;
+}
+
+static void output_manager_apply(struct wl_listener *listener, void *data) {
+    struct server *s = wl_container_of(listener, s, output_manager_apply);
+    struct wlr_output_configuration_v1 *config = data;
+    bool ok = output_config_apply(s, config, false);
+    TRACE(EV_OUTPUT_CONFIG, ok, 0);
+    if (ok) {
+        wlr_output_configuration_v1_send_succeeded(config);
+    } else {
+        wlr_output_configuration_v1_send_failed(config);
+    }
+    wlr_output_configuration_v1_destroy(config);
+    output_manager_update(s);
+}
+
+static void output_manager_test(struct wl_listener *listener, void *data) {
+    struct server *s = wl_container_of(listener, s, output_manager_test);
+    struct wlr_output_configuration_v1 *config = data;
+    bool ok = output_config_apply(s, config, true);
+    TRACE(EV_OUTPUT_CONFIG, ok, 1);
+    if (ok) {
+        wlr_output_configuration_v1_send_succeeded(config);
+    } else {
+        wlr_output_configuration_v1_send_failed(config);
+    }
+    wlr_output_configuration_v1_destroy(config);
+}
+
+static void output_commit(struct wl_listener *listener, void *data) {
+    struct output *output = wl_container_of(listener, output, commit);
+    struct wlr_output_event_commit *event = data;
+    
+    /* Resolution changed or first enabled: every workspace needs new geometry */
+    if (event->state->committed & (WLR_OUTPUT_STATE_MODE | WLR_OUTPUT_STATE_ENABLED)) {
+        /* Disabled: nothing to lay out at 0x0, its views go elsewhere. A
+         * replay can only stand in for that by removing the output. */
+        if (!output->wlr_output->enabled) {
+            record_emit(REC_OUTPUT_REMOVED, 0, output->id, 0, 0, 0, 0);
+            output_evacuate(output);
+            output_manager_update(output->server);
+            return;
+        }
+        record_emit(REC_OUTPUT, 0, output->id, output->wlr_output->width,
+            output->wlr_output->height, 0, 0);
+        if (output->wlr_output->refresh > 0) {
+            output->refresh_ns = NSEC_PER_SEC * 1000 / output->wlr_output->refresh;
+        }
+        for (int ws = 0; ws < output->server->config.workspaces; ws++) {
+            slot_dirty(output, ws, 0);
+            layout_workspace(output, ws);
+        }
+        bg_request(output);
+        indicator_update(output);
+        views_place_waiting(output->server);
+        output_manager_update(output->server);
+    }
+}
+
+static void output_destroy(struct wl_listener *listener, void *data) {
+    struct output *output = wl_container_of(listener, output, destroy);
+    struct server *s = output->server;
+    wl_list_remove(&output->frame.link);
+    wl_list_remove(&output->present.link);
+    wl_list_remove(&output->commit.link);
+    wl_list_remove(&output->destroy.link);
+    wl_event_source_remove(output->render_timer);
+    wl_event_source_remove(output->txn_timer);
+    
+    TRACE(EV_OUTPUT_REMOVED, output->id, output->frames_committed,
+        output->frames_skipped, output->deadlines_missed);
+    record_emit(REC_OUTPUT_REMOVED, 0, output->id, 0, 0, 0, 0);
+    
+    /* Remove from array */
+    for (int i = 0; i < s->output_count; i++) {
+        if (s->outputs[i] == output) {
+            s->outputs[i] = NULL;
+            break;
+        }
+    }
+    
+    /* Rescue views before their parent trees go away, then re-place them */
+    struct view *orphans[MAX_WORKSPACES * MAX_VIEWS_PER_WS];
+    int orphan_count = 0;
+    for (int ws = 0; ws < MAX_WORKSPACES; ws++) {
+        for (int slot = 0; slot < output->ws_count[ws]; slot++) {
+            struct view *v = output->workspaces[ws][slot];
+            v->in_txn = false;
+            v->txn_waiting = false;
+            wlr_scene_node_reparent(&v->scene_tree->node, &s->scene->tree);
+            wlr_scene_node_set_enabled(&v->scene_tree->node, false);
+            v->output = NULL;
+            orphans[orphan_count++] = v;
+        }
+    }
+    if (s->cmdbox_output == output) cmdbox_hide(s);
+    overlay_destroy(output->indicator);
+    wlr_scene_node_destroy(&output->tree->node);
+    free(output);
+    
+    for (int i = 0; i < orphan_count; i++) {
+        view_place(s, orphans[i]);
+    }
+    pointer_rehit(s);
+    ipc_changed(s);
+}
+
+static void new_output(struct wl_listener *listener, void *data) {
+    struct server *s = wl_container_of(listener, s, new_output);
+    struct wlr_output *wlr_output = data;
+    
+    /* Slots of unplugged outputs are reused, so docking never runs out */
+    int id = 0;
+    while (id < s->output_count && s->outputs[id]) id++;
+    if (id >= MAX_OUTPUTS) return;
+    
+    wlr_output_init_render(wlr_output, s->allocator, s->renderer);
+    
+    /* The modeset waits for any other outputs arriving in this iteration */
+    struct output *output = calloc(1, sizeof(*output));
+    output->server = s;
+    output->wlr_output = wlr_output;
+    output->current_ws = 0;
+    output->render_time_ns = RENDER_TIME_INIT_NS;
+    if (!s->outputs_idle) {
+        s->outputs_idle = wl_event_loop_add_idle(wl_display_get_event_loop(s->display),
+            outputs_configure, s);
+    }
+    output->render_timer = wl_event_loop_add_timer(
+        wl_display_get_event_loop(s->display), output_render_timer, output);
+    output->txn_timer = wl_event_loop_add_timer(
+        wl_display_get_event_loop(s->display), txn_timeout, output);
+    
+    /* Workspaces start empty, in the configured layout */
+    for (int i = 0; i < MAX_WORKSPACES; i++) {
+        output->ws_layout[i] = (enum layout)s->config.layout;
+        output->ws_shift[i] = MAX_VIEWS_PER_WS;
+        output->ws_redo[i] = MAX_VIEWS_PER_WS;
+    }
+    output->ws_free = (uint32_t)((1ull << MAX_WORKSPACES) - 1);
+    
+    output->frame.notify = output_frame;
+    wl_signal_add(&wlr_output->events.frame, &output->frame);
+    output->present.notify = output_present;
+    wl_signal_add(&wlr_output->events.present, &output->present);
+    output->destroy.notify = output_destroy;
+    wl_signal_add(&wlr_output->events.destroy, &output->destroy);
+    
+    output->commit.notify = output_commit;
+    wl_signal_add(&wlr_output->events.commit, &output->commit);
+    
+    struct wlr_output_layout_output *l_output =
+        wlr_output_layout_add_auto(s->output_layout, wlr_output);
+    output->scene_output = wlr_scene_output_create(s->scene, wlr_output);
+    
+    /* Without the link every scene output shows the region at 0,0 */
+    wlr_scene_output_layout_add_output(s->scene_layout, l_output, output->scene_output);
+    
+    output->tree = wlr_scene_tree_create(&s->scene->tree);
+    wlr_scene_node_set_position(&output->tree->node, l_output->x, l_output->y);
+    for (int i = 0; i < MAX_WORKSPACES; i++) {
+        output->ws_trees[i] = wlr_scene_tree_create(output->tree);
+        wlr_scene_node_set_enabled(&output->ws_trees[i]->node, i == output->current_ws);
+    }
+    
+    output->id = id;
+    s->outputs[id] = output;
+    if (id == s->output_count) s->output_count++;
+    indicator_update(output);
+    bg_request(output);
+    pointer_rehit(s);
+    ipc_changed(s);
+    
+    TRACE(EV_OUTPUT_ADDED, output->id, s->output_count);
+}
+
+/* Keep workspace trees aligned with the output layout */
+static void layout_change(struct wl_listener *listener, void *data) {
+    struct server *s = wl_container_of(listener, s, layout_change);
+    for (int i = 0; i < s->output_count; i++) {
+        struct output *o = s->outputs[i];
+        if (!o) continue;
+        struct wlr_output_layout_output *l_output =
+            wlr_output_layout_get(s->output_layout, o->wlr_output);
+        if (l_output) {
+            wlr_scene_node_set_position(&o->tree->node, l_output->x, l_output->y);
+        }
+    }
+    output_manager_update(s);
+}
+
+/* Strip views off workspaces that no longer exist, then re-place every
+ * mapped view that lacks a slot; only the receiving workspaces re-layout.
+ * Views past a lowered views_per_workspace stay where they are. */
+static void config_apply_workspaces(struct server *s, int old_count) {
+    for (int i = 0; i < s->output_count; i++) {
+        struct output *o = s->outputs[i];
+        if (!o) continue;
+        
+        for (int ws = 0; ws < MAX_WORKSPACES; ws++) {
+            slot_free_update(o, ws);
+        }
+        if (o->current_ws >= s->config.workspaces) {
+            TRACE(EV_WS_SWITCH, o->id, o->current_ws + 1, s->config.workspaces);
+            switch_workspace(o, s->config.workspaces - 1);
+        }
+        for (int ws = s->config.workspaces; ws < old_count; ws++) {
+            for (int slot = o->ws_count[ws] - 1; slot >= 0; slot--) {
+                struct view *v = o->workspaces[ws][slot];
+                txn_remove(o, v);
+                slot_release(o, ws, slot);
+                wlr_scene_node_reparent(&v->scene_tree->node, &s->scene->tree);
+                wlr_scene_node_set_enabled(&v->scene_tree->node, false);
+                v->output = NULL;
+            }
+        }
+    }
+    
+    views_place_waiting(s);
+}
+
+/* Apply only what differs from the running config; returns the number of
+ * settings that changed */
+static int config_apply(struct server *s, const struct config *c) {
+    struct config old = s->config;
+    s->config = *c;
+    int changes = 0;
+    
+    if (c->workspaces != old.workspaces || c->views_per_workspace != old.views_per_workspace) {
+        config_apply_workspaces(s, old.workspaces);
+        ipc_changed(s);
+        changes++;
+    }
+    
+    /* Resets layouts chosen by binding too */
+    if (c->layout != old.layout) {
+        for (int i = 0; i < s->output_count; i++) {
+            struct output *o = s->outputs[i];
+            for (int ws = 0; o && ws < MAX_WORKSPACES; ws++) {
+                o->ws_layout[ws] = (enum layout)c->layout;
+                slot_dirty(o, ws, 0);
+                if (ws < c->workspaces) layout_workspace(o, ws);
+            }
+        }
+        changes++;
+    }
+    
+    /* Old buffers stay on screen (scene nodes hold locks) until the new ones are ready */
+    if (strcmp(c->background_image, old.background_image) != 0) {
+        s->bg_generation++;
+        for (int i = 0; i < s->bg_count; i++) {
+            bg_buffer_drop(s->bg_buffers[i]);
+        }
+        s->bg_count = 0;
+        s->bg_pending_count = 0;
+        for (int i = 0; i < s->output_count; i++) {
+            if (s->outputs[i]) bg_request(s->outputs[i]);
+        }
+        changes++;
+    }
+    
+    /* Glyphs are cached per font, so a new font starts a new atlas. While
+     * the startup worker owns the font, it is swapped when that finishes. */
+    bool font_changed = strcmp(c->font, old.font) != 0;
+    if (font_changed) {
+        if (startup_deferred_done(s)) font_unload();
+        cmdbox_hide(s);
+        changes++;
+    }
+    if (font_changed || c->workspaces != old.workspaces) {
+        for (int i = 0; i < s->output_count; i++) {
+            if (!s->outputs[i]) continue;
+            overlay_destroy(s->outputs[i]->indicator);
+            s->outputs[i]->indicator = NULL;
+            indicator_update(s->outputs[i]);
+        }
+        cmdbox_redraw(s);
+    }
+    
+    /* Read on the next frame, the next map and the next trigger respectively */
+    if (c->max_render_time != old.max_render_time) changes++;
+    if (c->placement != old.placement) changes++;
+    if (c->memory_pressure != old.memory_pressure) changes++;
+    
+    /* Suspends or resumes what is hidden now; shrunk views stay small until shown */
+    if (c->hidden_views != old.hidden_views) {
+        for (int i = 0; i < s->output_count; i++) {
+            struct output *o = s->outputs[i];
+            for (int ws = 0; o && ws < s->config.workspaces; ws++) {
+                if (ws == o->current_ws) continue;
+                workspace_set_hidden(o, ws, true);
+                layout_workspace(o, ws);
+            }
+        }
+        changes++;
+    }
+    
+    if (c->bind_count != old.bind_count ||
+            memcmp(c->binds, old.binds, sizeof(c->binds[0]) * c->bind_count) != 0) {
+        bindings_compile(&s->bindings, &s->config);
+        s->bind_mode = 0;
+        changes++;
+    }
+    
+    return changes;
+}
+
+/* A file with errors is rejected as a whole so a typo can't reshuffle
+ * windows; returns the number of errors */
+static int config_reload_now(struct server *s) {
+    struct config c;
+    int errors = config_load(s->config_path, &c);
+    if (errors > 0) {
+        TRACE(EV_CONFIG_REJECTED, errors);
+        fprintf(stderr, "Config: %d errors, keeping current settings\n", errors);
+        return errors;
     }
+    TRACE(EV_CONFIG_RELOAD, config_apply(s, &c));
+    return 0;
+}
+
+/* Same rule at startup, where the fallback is the defaults */
+static void config_load_startup(struct server *s) {
+    int errors = config_load(s->config_path, &s->config);
+    if (errors > 0) {
+        fprintf(stderr, "Config: %d errors, using the defaults\n", errors);
+        config_defaults(&s->config);
+    }
+}
+
+static int config_reload(void *data) {
+    config_reload_now(data);
+    return 0;
+}
+
+static bool config_watch_dir(struct server *s);
+
+static int config_changed(int fd, uint32_t mask, void *data) {
+    struct server *s = data;
+    const char *name = strrchr(s->config_path, '/') + 1;
+    union {
+        struct inotify_event ev;
+        char buf[4096];
+    } u;
     
-    wlr_seat_set_capabilities(s->seat, WL_SEAT_CAPABILITY_POINTER | WL_SEAT_CAPABILITY_KEYBOARD);
+    bool changed = false;
+    ssize_t len;
+    while ((len = read(fd, u.buf, sizeof(u.buf))) > 0) {
+        for (char *p = u.buf; p < u.buf + len; ) {
+            struct inotify_event *ev = (struct inotify_event *)p;
+            if (ev->len && strcmp(ev->name, name) == 0) changed = true;
+            if (s->config_wd_parent) changed = true;
+            p += sizeof(*ev) + ev->len;
+        }
+    }
+    
+    /* Something appeared in a parent: move the watch down if we can */
+    if (s->config_wd_parent) changed = changed && config_watch_dir(s);
+    if (changed) wl_event_source_timer_update(s->config_timer, CONFIG_RELOAD_DELAY_MS);
+    return 0;
 }
 
-static void view_map(struct wl_listener *listener, void *data) {
-    struct view *view = wl_container_of(listener, view, map);
-    view->mapped = true;
+static int pressure_timeout(void *data) {
+    struct server *s = data;
+    s->under_pressure = false;
+    return 0;
+}
+
+/* Reading the epoll fd consumes the trigger; PSI fires at most once per window */
+static int pressure_event(int fd, uint32_t mask, void *data) {
+    struct server *s = data;
+    struct epoll_event ev;
+    while (epoll_wait(fd, &ev, 1, 0) > 0) {
+    }
+    if (s->config.memory_pressure == PRESSURE_IGNORE) return 0;
     
-    struct output *output;
-    int ws, slot;
+    bool was = s->under_pressure;
+    s->under_pressure = true;
+    wl_event_source_timer_update(s->pressure_timer, PRESSURE_HOLD_MS);
+    if (was) return 0;
     
-    if (find_space(view->server, &output, &ws, &slot)) {
-        view->output = output;
-        view->workspace = ws;
-        view->ws_slot = slot;
-        output->workspaces[ws][slot] = view;
-        
-        layout_workspace(output);
-        wlr_seat_keyboard_notify_enter(view->server->seat,
-            view->xdg_toplevel->base->surface, NULL, 0, NULL);
-        
-        fprintf(stderr, "[VIEW] Mapped to WS %d slot %d\n", ws + 1, slot);
-    } else {
-        wlr_scene_node_set_enabled(&view->scene_tree->node, false);
-        fprintf(stderr, "[VIEW] All workspaces full\n");
+    int hidden = 0;
+    for (int i = 0; i < s->output_count; i++) {
+        struct output *o = s->outputs[i];
+        for (int ws = 0; o && ws < s->config.workspaces; ws++) {
+            if (ws == o->current_ws) continue;
+            hidden += o->ws_count[ws];
+            workspace_set_hidden(o, ws, true);
+        }
     }
+    TRACE(EV_MEMORY_PRESSURE, hidden);
+    return 0;
 }
 
-static void view_unmap(struct wl_listener *listener, void *data) {
-    struct view *view = wl_container_of(listener, view, unmap);
-    view->mapped = false;
+/* Without PSI, or permission to add a trigger, pressure never fires */
+static void pressure_init(struct server *s) {
+    s->pressure_fd = open("/proc/pressure/memory", O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (s->pressure_fd < 0) {
+        fprintf(stderr, "Memory pressure: cannot open /proc/pressure/memory: %s\n",
+            strerror(errno));
+        return;
+    }
     
-    if (view->output) {
-        view->output->workspaces[view->workspace][view->ws_slot] = NULL;
-        layout_workspace(view->output);
-        view->output = NULL;
+    /* The trigger lives as long as this fd stays open */
+    int ep = -1;
+    struct epoll_event ev = { .events = EPOLLPRI };
+    if (write(s->pressure_fd, PSI_TRIGGER, strlen(PSI_TRIGGER) + 1) < 0 ||
+            (ep = epoll_create1(EPOLL_CLOEXEC)) < 0 ||
+            epoll_ctl(ep, EPOLL_CTL_ADD, s->pressure_fd, &ev) != 0) {
+        fprintf(stderr, "Memory pressure: cannot arm trigger '%s': %s\n",
+            PSI_TRIGGER, strerror(errno));
+        if (ep >= 0) close(ep);
+        close(s->pressure_fd);
+        s->pressure_fd = -1;
+        return;
     }
+    
+    struct wl_event_loop *loop = wl_display_get_event_loop(s->display);
+    s->pressure_timer = wl_event_loop_add_timer(loop, pressure_timeout, s);
+    wl_event_loop_add_fd(loop, ep, WL_EVENT_READABLE, pressure_event, s);
 }
 
-static void view_destroy(struct wl_listener *listener, void *data) {
-    struct view *view = wl_container_of(listener, view, destroy);
+/* Until the config directory exists, watch the closest parent that does
+ * and move down as directories appear. Returns true once the config
+ * directory itself is watched. */
+static bool config_watch_dir(struct server *s) {
+    char dir[PATH_MAX];
+    snprintf(dir, sizeof(dir), "%s", s->config_path);
+    *strrchr(dir, '/') = '\0';
     
-    wl_list_remove(&view->map.link);
-    wl_list_remove(&view->unmap.link);
-    wl_list_remove(&view->destroy.link);
+    bool parent = false;
+    for (;;) {
+        int wd = inotify_add_watch(s->config_inotify_fd, dir[0] ? dir : "/", parent ?
+            IN_CREATE | IN_MOVED_TO :
+            IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE);
+        if (wd >= 0) {
+            if (s->config_wd >= 0 && s->config_wd != wd) {
+                inotify_rm_watch(s->config_inotify_fd, s->config_wd);
+            }
+            s->config_wd = wd;
+            s->config_wd_parent = parent;
+            return !parent;
+        }
+        char *slash = strrchr(dir, '/');
+        if (errno != ENOENT || !slash) return false;
+        *slash = '\0';
+        parent = true;
+    }
+}
+
+/* Watch the directory, not the file: editors save by renaming over it */
+static void config_watch(struct server *s) {
+    s->config_inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (s->config_inotify_fd < 0) return;
+    s->config_wd = -1;
+    config_watch_dir(s);
+    if (s->config_wd < 0) {
+        fprintf(stderr, "Config: cannot watch %s, hot reload disabled\n", s->config_path);
+        close(s->config_inotify_fd);
+        s->config_inotify_fd = -1;
+        return;
+    }
     
-    /* Remove from views array */
-    for (int i = 0; i < view->server->view_count; i++) {
-        if (view->server->views[i] == view) {
-            view->server->views[i] = NULL;
-            break;
+    struct wl_event_loop *loop = wl_display_get_event_loop(s->display);
+    s->config_timer = wl_event_loop_add_timer(loop, config_reload, s);
+    wl_event_loop_add_fd(loop, s->config_inotify_fd, WL_EVENT_READABLE, config_changed, s);
+}
+
+/* One JSON line per output and histogram; p999 is the 99.9th percentile */
+static void stats_dump(struct server *s, FILE *f) {
+    for (int i = 0; i < s->output_count; i++) {
+        struct output *o = s->outputs[i];
+        if (!o) continue;
+        const struct {
+            const char *name;
+            const struct histogram *h;
+        } hists[] = {
+            { "render_us", &o->hist_render },
+            { "commit_to_present_us", &o->hist_present },
+            { "missed_vblanks", &o->hist_missed },
+            { "input_to_present_us", &o->hist_input },
+        };
+        for (size_t j = 0; j < sizeof(hists) / sizeof(hists[0]); j++) {
+            const struct histogram *h = hists[j].h;
+            fprintf(f, "{\"output\":\"%s\",\"name\":\"%s\",\"count\":%llu,"
+                "\"mean\":%.1f,\"p50\":%llu,\"p90\":%llu,\"p99\":%llu,"
+                "\"p999\":%llu,\"max\":%llu}\n",
+                o->wlr_output->name, hists[j].name, (unsigned long long)h->total,
+                h->total ? (double)h->sum / h->total : 0.0,
+                (unsigned long long)hist_percentile(h, 50),
+                (unsigned long long)hist_percentile(h, 90),
+                (unsigned long long)hist_percentile(h, 99),
+                (unsigned long long)hist_percentile(h, 99.9),
+                (unsigned long long)h->max);
         }
     }
+}
+
+/* SIGUSR2: replace the stats file in one rename so readers never see half */
+static int stats_signal(int sig, void *data) {
+    struct server *s = data;
+    char tmp[sizeof(s->stats_path) + 8];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", s->stats_path);
     
-    free(view);
+    /* The path may be in a shared /tmp: create the file fresh, never
+     * through a link someone else left there */
+    unlink(tmp);
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0600);
+    FILE *f = fd >= 0 ? fdopen(fd, "w") : NULL;
+    if (!f) {
+        if (fd >= 0) close(fd);
+        fprintf(stderr, "Stats: cannot write %s\n", tmp);
+        return 0;
+    }
+    stats_dump(s, f);
+    if (fclose(f) != 0 || rename(tmp, s->stats_path) != 0) {
+        fprintf(stderr, "Stats: cannot write %s\n", s->stats_path);
+        unlink(tmp);
+    }
+    return 0;
 }
 
-static void new_xdg_surface(struct wl_listener *listener, void *data) {
-    struct server *s = wl_container_of(listener, s, new_xdg_surface);
-    struct wlr_xdg_surface *xdg_surface = data;
+/* IPC commands. Handlers return NULL on success or the error text, and
+ * may send output lines before the final "ok". */
+static struct view *ipc_view_arg(struct server *s, const char *arg) {
+    struct view_handle h;
+    if (!arg || !arg[0]) return view_get(&s->views, s->focused);
+    if (sscanf(arg, "%u:%u", &h.index, &h.generation) != 2) return NULL;
+    return view_get(&s->views, h);
+}
+
+static int ipc_workspace_arg(struct server *s, char **args) {
+    char *word = strtok_r(NULL, " \t", args);
+    char *end;
+    long ws = word ? strtol(word, &end, 10) : 0;
+    return word && !*end && ws >= 1 && ws <= s->config.workspaces ? (int)ws - 1 : -1;
+}
+
+/* Move a view to another workspace on its output; focus stays behind */
+static bool view_move(struct server *s, struct view *v, int ws) {
+    struct output *o = v->output;
+    if (!o) return false;
+    if (ws == v->workspace) return true;
+    if (!(o->ws_free & (1u << ws))) return false;
     
-    if (xdg_surface->role != WLR_XDG_SURFACE_ROLE_TOPLEVEL) return;
-    if (s->view_count >= MAX_VIEWS) return;
+    int old_ws = v->workspace;
+    int old_slot = v->ws_slot;
+    int slot = o->ws_count[ws];
+    txn_remove(o, v);
+    slot_release(o, old_ws, v->ws_slot);
+    slot_take(o, ws, slot, v);
+    v->workspace = ws;
+    v->ws_slot = slot;
+    wlr_scene_node_reparent(&v->scene_tree->node, o->ws_trees[ws]);
+    layout_workspace(o, old_ws);
+    layout_workspace(o, ws);
     
-    struct view *view = calloc(1, sizeof(*view));
-    view->server = s;
-    view->xdg_toplevel = xdg_surface->toplevel;
-    view->scene_tree = wlr_scene_xdg_surface_create(&s->scene->tree, xdg_surface);
+    if (view_get(&s->views, s->focused) == v && ws != o->current_ws) {
+        view_focus(s, slot_neighbour(o, old_ws, old_slot));
+    }
+    pointer_rehit(s);
+    ipc_event(s, IPC_EVENT_VIEW, "event move %u:%u %s %d", v->index, v->generation,
+        o->wlr_output->name, ws + 1);
+    ipc_changed(s);
+    return true;
+}
+
+static const char *ipc_cmd_workspace(struct server *s, struct ipc_client *c, char *args) {
+    int ws = ipc_workspace_arg(s, &args);
+    if (ws < 0) return "workspace out of range";
+    switch_all_workspaces(s, ws, 0);
+    return NULL;
+}
+
+static const char *ipc_cmd_move(struct server *s, struct ipc_client *c, char *args) {
+    int ws = ipc_workspace_arg(s, &args);
+    if (ws < 0) return "workspace out of range";
+    struct view *v = ipc_view_arg(s, strtok_r(NULL, " \t", &args));
+    if (!v || !v->output) return "no such view";
+    return view_move(s, v, ws) ? NULL : "workspace full";
+}
+
+static const char *ipc_cmd_exec(struct server *s, struct ipc_client *c, char *args) {
+    args += strspn(args, " \t");
+    if (!*args) return "nothing to run";
+    exec_command(s, args);
+    return NULL;
+}
+
+static const char *ipc_cmd_reload(struct server *s, struct ipc_client *c, char *args) {
+    return config_reload_now(s) ? "config has errors, see the compositor log" : NULL;
+}
+
+static const char *ipc_cmd_stats(struct server *s, struct ipc_client *c, char *args) {
+    char *buf = NULL;
+    size_t len = 0;
+    FILE *f = open_memstream(&buf, &len);
+    if (!f) return "out of memory";
+    stats_dump(s, f);
+    fclose(f);
+    ipc_send(s, c, buf, len);
+    free(buf);
+    return NULL;
+}
+
+static const char *ipc_cmd_subscribe(struct server *s, struct ipc_client *c, char *args) {
+    static const char *const names[] = {
+#define X(ev, name) [ev##_BIT] = name,
+        IPC_EVENTS(X)
+#undef X
+    };
+    uint32_t events = 0;
+    for (char *word; (word = strtok_r(NULL, " \t", &args)); ) {
+        size_t i = 0;
+        while (i < sizeof(names) / sizeof(names[0]) && strcmp(word, names[i]) != 0) i++;
+        if (i == sizeof(names) / sizeof(names[0])) return "unknown event";
+        events |= 1u << i;
+    }
+    if (!events) return "no events given";
+    c->events |= events;
+    return NULL;
+}
+
+static const struct {
+    const char *name;
+    const char *(*run)(struct server *s, struct ipc_client *c, char *args);
+} ipc_commands[] = {
+    { "workspace", ipc_cmd_workspace },
+    { "move", ipc_cmd_move },
+    { "exec", ipc_cmd_exec },
+    { "reload", ipc_cmd_reload },
+    { "stats", ipc_cmd_stats },
+    { "subscribe", ipc_cmd_subscribe },
+};
+
+static void ipc_command(struct server *s, struct ipc_client *c, char *line) {
+    char *args;
+    char *name = strtok_r(line, " \t", &args);
+    if (!name) return;
     
-    view->map.notify = view_map;
-    wl_signal_add(&xdg_surface->surface->events.map, &view->map);
-    view->unmap.notify = view_unmap;
-    wl_signal_add(&xdg_surface->surface->events.unmap, &view->unmap);
-    view->destroy.notify = view_destroy;
-    wl_signal_add(&xdg_surface->events.destroy, &view->destroy);
+    const char *error = "unknown command";
+    for (size_t i = 0; i < sizeof(ipc_commands) / sizeof(ipc_commands[0]); i++) {
+        if (strcmp(name, ipc_commands[i].name) == 0) {
+            error = ipc_commands[i].run(s, c, args);
+            break;
+        }
+    }
     
-    s->views[s->view_count++] = view;
+    char reply[128];
+    int len = error ? snprintf(reply, sizeof(reply), "error %s\n", error) :
+        snprintf(reply, sizeof(reply), "ok\n");
+    ipc_send(s, c, reply, len);
 }
 
-static void output_frame(struct wl_listener *listener, void *data) {
-    struct output *output = wl_container_of(listener, output, frame);
-    struct wlr_scene_output *scene_output = wlr_scene_get_scene_output(
-        output->server->scene, output->wlr_output);
+static int ipc_client_event(int fd, uint32_t mask, void *data) {
+    struct ipc_client *c = data;
+    struct server *s = &g_server;
+    if (c->broken) return 0;
+    if (mask & (WL_EVENT_HANGUP | WL_EVENT_ERROR)) {
+        ipc_client_break(s, c);
+        return 0;
+    }
+    if (mask & WL_EVENT_WRITABLE) ipc_flush(s, c);
+    if (!(mask & WL_EVENT_READABLE)) return 0;
     
-    wlr_scene_output_commit(scene_output, NULL);
+    ssize_t n = read(fd, c->in + c->in_len, sizeof(c->in) - c->in_len);
+    if (n <= 0) {
+        if (n == 0 || (errno != EAGAIN && errno != EINTR)) ipc_client_break(s, c);
+        return 0;
+    }
+    c->in_len += n;
     
-    struct timespec now;
-    clock_gettime(CLOCK_MONOTONIC, &now);
-    wlr_scene_output_send_frame_done(scene_output, &now);
+    char *start = c->in, *nl;
+    while (!c->broken && (nl = memchr(start, '\n', c->in + c->in_len - start))) {
+        *nl = '\0';
+        ipc_command(s, c, start);
+        start = nl + 1;
+    }
+    c->in_len -= start - c->in;
+    memmove(c->in, start, c->in_len);
+    if (c->in_len == sizeof(c->in)) {
+        static const char too_long[] = "error line too long\n";
+        ipc_send(s, c, too_long, sizeof(too_long) - 1);
+        ipc_client_break(s, c);
+    }
+    return 0;
 }
 
-static void output_destroy(struct wl_listener *listener, void *data) {
-    struct output *output = wl_container_of(listener, output, destroy);
-    wl_list_remove(&output->frame.link);
-    wl_list_remove(&output->destroy.link);
+static int ipc_accept(int fd, uint32_t mask, void *data) {
+    struct server *s = data;
+    int client = accept(fd, NULL, NULL);
+    if (client < 0) return 0;
+    fcntl(client, F_SETFD, FD_CLOEXEC);
+    fcntl(client, F_SETFL, O_NONBLOCK);
     
-    /* Remove from array */
-    for (int i = 0; i < output->server->output_count; i++) {
-        if (output->server->outputs[i] == output) {
-            output->server->outputs[i] = NULL;
-            break;
+    int i = 0;
+    while (i < IPC_MAX_CLIENTS && s->ipc_clients[i]) i++;
+    struct ipc_client *c = i < IPC_MAX_CLIENTS ? calloc(1, sizeof(*c)) : NULL;
+    if (!c) {
+        close(client);
+        return 0;
+    }
+    c->fd = client;
+    c->source = wl_event_loop_add_fd(wl_display_get_event_loop(s->display), client,
+        WL_EVENT_READABLE, ipc_client_event, c);
+    s->ipc_clients[i] = c;
+    return 0;
+}
+
+/* Socket and snapshot live next to the Wayland socket and are named after it */
+static void ipc_init(struct server *s, const char *socket_name) {
+    const char *runtime = getenv("XDG_RUNTIME_DIR");
+    if (!runtime) runtime = "/tmp";
+    snprintf(s->snapshot_path, sizeof(s->snapshot_path), "%s/eldinwm-%s.state",
+        runtime, socket_name);
+    
+    /* Without XDG_RUNTIME_DIR this is a shared /tmp: create the file fresh,
+     * never through a link someone else left there */
+    unlink(s->snapshot_path);
+    int fd = open(s->snapshot_path, O_RDWR | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0600);
+    if (fd >= 0 && ftruncate(fd, sizeof(struct ipc_snapshot)) == 0) {
+        void *map = mmap(NULL, sizeof(struct ipc_snapshot), PROT_READ | PROT_WRITE,
+            MAP_SHARED, fd, 0);
+        if (map != MAP_FAILED) {
+            s->snapshot = map;
+            memcpy(s->snapshot->magic, IPC_SNAPSHOT_MAGIC, sizeof(s->snapshot->magic));
+            s->snapshot->size = sizeof(struct ipc_snapshot);
+            snapshot_publish(s);
+            setenv(IPC_SNAPSHOT_ENV, s->snapshot_path, 1);
+            launcher_setenv(s, IPC_SNAPSHOT_ENV, s->snapshot_path);
         }
     }
+    if (fd >= 0) close(fd);
+    if (!s->snapshot) fprintf(stderr, "IPC: cannot map %s\n", s->snapshot_path);
     
-    free(output);
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    snprintf(s->ipc_path, sizeof(s->ipc_path), "%s/eldinwm-%s.sock", runtime, socket_name);
+    s->ipc_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (strlen(s->ipc_path) >= sizeof(addr.sun_path) || s->ipc_fd < 0) {
+        fprintf(stderr, "IPC: cannot create socket %s\n", s->ipc_path);
+        if (s->ipc_fd >= 0) close(s->ipc_fd);
+        s->ipc_fd = -1;
+        return;
+    }
+    memcpy(addr.sun_path, s->ipc_path, strlen(s->ipc_path) + 1);
+    unlink(s->ipc_path);
+    if (bind(s->ipc_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+            listen(s->ipc_fd, 8) != 0) {
+        fprintf(stderr, "IPC: cannot listen on %s\n", s->ipc_path);
+        close(s->ipc_fd);
+        s->ipc_fd = -1;
+        return;
+    }
+    wl_event_loop_add_fd(wl_display_get_event_loop(s->display), s->ipc_fd,
+        WL_EVENT_READABLE, ipc_accept, s);
+    setenv(IPC_SOCKET_ENV, s->ipc_path, 1);
+    launcher_setenv(s, IPC_SOCKET_ENV, s->ipc_path);
 }
 
-static void new_output(struct wl_listener *listener, void *data) {
-    struct server *s = wl_container_of(listener, s, new_output);
-    struct wlr_output *wlr_output = data;
+static void ipc_finish(struct server *s) {
+    for (int i = 0; i < IPC_MAX_CLIENTS; i++) {
+        if (s->ipc_clients[i]) ipc_client_close(s, s->ipc_clients[i]);
+    }
+    if (s->ipc_fd >= 0) {
+        close(s->ipc_fd);
+        unlink(s->ipc_path);
+    }
+    if (s->snapshot) {
+        munmap(s->snapshot, sizeof(struct ipc_snapshot));
+        unlink(s->snapshot_path);
+        s->snapshot = NULL;
+    }
+}
+
+/* Nanoseconds per key, averaged over batches since one lookup is far
+ * below clock resolution */
+static void bench_key_dispatch(struct server *s, const char *name, uint32_t mods,
+        xkb_keysym_t sym) {
+    enum { ROUNDS = 100, BATCH = 1000 };
+    volatile uintptr_t sink = 0;
     
-    if (s->output_count >= MAX_OUTPUTS) return;
+    printf(",\"%s\":[", name);
+    for (int r = 0; r < ROUNDS; r++) {
+        int64_t start = now_ns();
+        for (int i = 0; i < BATCH; i++) {
+            if (bindings_want(s, mods)) sink += (uintptr_t)key_match(s, mods, &sym, 1);
+        }
+        printf("%s%lld", r ? "," : "", (long long)((now_ns() - start) / BATCH));
+    }
+    printf("]");
+    (void)sink;
+}
+
+/* The mode 0 combo bound to an action, if any */
+static bool bench_find_binding(struct server *s, enum action action,
+        uint32_t *mods, xkb_keysym_t *sym) {
+    for (int i = 0; i < BIND_TABLE_SIZE; i++) {
+        const struct binding *b = &s->bindings.table[i];
+        if (b->key && b->key >> 40 == 1 && b->action == action) {
+            *mods = (b->key >> 32) & 0xff;
+            *sym = b->key & 0xffffffff;
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Benchmark hook: SIGUSR1 runs a switch storm through the key binding path
+ * and reports per-switch latency, then key dispatch cost, as two JSON
+ * lines on stdout. Presses enter handle_key's path at the keysym: the
+ * headless backend has no keyboard whose keycodes could be translated.
+ * Without workspace-next/prev bindings the switches run directly. */
+static int bench_switch_storm(int sig, void *data) {
+    struct server *s = data;
+    uint32_t mods[2];
+    xkb_keysym_t syms[2];
+    bool bound = bench_find_binding(s, ACTION_WORKSPACE_NEXT, &mods[0], &syms[0]) &&
+        bench_find_binding(s, ACTION_WORKSPACE_PREV, &mods[1], &syms[1]);
     
-    wlr_output_init_render(wlr_output, s->allocator, s->renderer);
+    printf("{\"event\":\"switch\",\"ns\":[");
+    for (int i = 0; i < s->bench_switches; i++) {
+        int64_t start = now_ns();
+        const struct binding *b = NULL;
+        if (bound && bindings_want(s, mods[i & 1])) {
+            b = key_match(s, mods[i & 1], &syms[i & 1], 1);
+        }
+        if (b) {
+            binding_run(s, b);
+        } else {
+            switch_all_workspaces(s, 0, (i & 1) ? -1 : 1);
+        }
+        printf("%s%lld", i ? "," : "", (long long)(now_ns() - start));
+    }
+    printf("]}\n");
     
-    struct wlr_output_state state;
-    wlr_output_state_init(&state);
-    wlr_output_state_set_enabled(&state, true);
+    /* Dispatch cost of the first bound combo, a miss and plain typing */
+    uint32_t bound_mods = 0;
+    xkb_keysym_t bound_sym = XKB_KEY_NoSymbol;
+    for (int i = 0; i < BIND_TABLE_SIZE && bound_sym == XKB_KEY_NoSymbol; i++) {
+        const struct binding *b = &s->bindings.table[i];
+        if (b->key && b->key >> 40 == 1) {
+            bound_mods = (b->key >> 32) & 0xff;
+            bound_sym = b->key & 0xffffffff;
+        }
+    }
+    printf("{\"event\":\"keys\"");
+    bench_key_dispatch(s, "bound_ns", bound_mods, bound_sym);
+    bench_key_dispatch(s, "miss_ns", bound_mods, XKB_KEY_q);
+    bench_key_dispatch(s, "plain_ns", 0, XKB_KEY_a);
+    printf("}\n");
+    fflush(stdout);
+    return 0;
+}
+
+static const char *const record_type_names[] = {
+#define X(type, name) [type] = name,
+    RECORD_TYPES(X)
+#undef X
+};
+
+static const struct wlr_keyboard_impl replay_keyboard_impl = {
+    .name = "eldinwm-replay-keyboard",
+};
+
+static const struct wlr_pointer_impl replay_pointer_impl = {
+    .name = "eldinwm-replay-pointer",
+};
+
+/* Maps the whole file; the records are read in place */
+static bool replay_load(const char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        fprintf(stderr, "Replay: cannot open %s\n", path);
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(struct record_header)) {
+        fprintf(stderr, "Replay: %s is not a recording\n", path);
+        close(fd);
+        return false;
+    }
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return false;
     
-    struct wlr_output_mode *mode = wlr_output_preferred_mode(wlr_output);
-    if (mode) wlr_output_state_set_mode(&state, mode);
+    const struct record_header *header = map;
+    if (memcmp(header->magic, RECORD_MAGIC, sizeof(header->magic)) != 0 ||
+            header->record_size != sizeof(struct input_record)) {
+        fprintf(stderr, "Replay: %s is not a recording of this version\n", path);
+        munmap(map, st.st_size);
+        return false;
+    }
+    if (header->dropped) {
+        fprintf(stderr, "Replay: %s lost %u events while recording\n", path, header->dropped);
+    }
     
-    wlr_output_commit_state(wlr_output, &state);
-    wlr_output_state_finish(&state);
+    g_replay.map = map;
+    g_replay.map_size = st.st_size;
+    g_replay.records = (const struct input_record *)(header + 1);
+    g_replay.count = (st.st_size - sizeof(*header)) / sizeof(struct input_record);
+    return true;
+}
+
+/* Recorded outputs become headless outputs of the recorded size */
+static void replay_output(struct server *s, const struct input_record *rec) {
+    if (rec->value < 0 || rec->value >= MAX_OUTPUTS) return;
+    struct wlr_output **slot = &g_replay.outputs[rec->value];
     
-    struct output *output = calloc(1, sizeof(*output));
-    output->server = s;
-    output->wlr_output = wlr_output;
-    output->current_ws = 0;
+    if (rec->type == REC_OUTPUT_REMOVED) {
+        if (*slot) wlr_output_destroy(*slot);
+        *slot = NULL;
+    } else if (!*slot) {
+        *slot = wlr_headless_add_output(s->backend, (unsigned)rec->x, (unsigned)rec->y);
+    } else if ((*slot)->width != (int)rec->x || (*slot)->height != (int)rec->y) {
+        struct wlr_output_state state;
+        wlr_output_state_init(&state);
+        wlr_output_state_set_custom_mode(&state, (int32_t)rec->x, (int32_t)rec->y, 0);
+        wlr_output_commit_state(*slot, &state);
+        wlr_output_state_finish(&state);
+    }
+}
+
+static void replay_dispatch(struct server *s, const struct input_record *rec) {
+    uint32_t msec = (uint32_t)(now_ns() / NSEC_PER_MSEC);
+    struct wlr_pointer *pointer = &g_replay.pointer;
     
-    /* Initialize workspace array to NULL */
-    for (int i = 0; i < MAX_WORKSPACES; i++) {
-        for (int j = 0; j < VIEWS_PER_WS; j++) {
-            output->workspaces[i][j] = NULL;
+    switch ((enum record_type)rec->type) {
+        case REC_KEY: {
+            struct wlr_keyboard_key_event event = {
+                .time_msec = msec, .keycode = rec->value, .update_state = true,
+                .state = rec->code,
+            };
+            wlr_keyboard_notify_key(&g_replay.keyboard, &event);
+            break;
+        }
+        case REC_MOTION: {
+            struct wlr_pointer_motion_event event = {
+                .pointer = pointer, .time_msec = msec, .delta_x = rec->x, .delta_y = rec->y,
+                .unaccel_dx = rec->ux, .unaccel_dy = rec->uy,
+            };
+            wl_signal_emit_mutable(&pointer->events.motion, &event);
+            break;
+        }
+        case REC_MOTION_ABSOLUTE: {
+            struct wlr_pointer_motion_absolute_event event = {
+                .pointer = pointer, .time_msec = msec, .x = rec->x, .y = rec->y,
+            };
+            wl_signal_emit_mutable(&pointer->events.motion_absolute, &event);
+            break;
+        }
+        case REC_BUTTON: {
+            struct wlr_pointer_button_event event = {
+                .pointer = pointer, .time_msec = msec, .button = rec->value,
+                .state = rec->code,
+            };
+            wl_signal_emit_mutable(&pointer->events.button, &event);
+            break;
+        }
+        case REC_AXIS: {
+            struct wlr_pointer_axis_event event = {
+                .pointer = pointer, .time_msec = msec,
+                .orientation = rec->code & 0xf, .source = (rec->code >> 4) & 0xf,
+                .relative_direction = rec->code >> 8,
+                .delta = rec->x, .delta_discrete = rec->value,
+            };
+            wl_signal_emit_mutable(&pointer->events.axis, &event);
+            break;
         }
+        case REC_FRAME:
+            wl_signal_emit_mutable(&pointer->events.frame, pointer);
+            break;
+        case REC_OUTPUT:
+        case REC_OUTPUT_REMOVED:
+            replay_output(s, rec);
+            break;
+        case REC_VIEW_MAPPED:
+            g_replay.views_expected++;
+            break;
+        case REC_VIEW_UNMAPPED:
+            g_replay.views_expected--;
+            break;
+        case RECORD_TYPE_COUNT:
+            break;
     }
+}
+
+/* One JSON line on stdout, latencies per event type in nanoseconds */
+static void replay_report(void) {
+    int64_t elapsed = now_ns() - g_replay.start_ns;
+    printf("{\"event\":\"replay\",\"events\":%zu,\"speed\":%.2f,\"us\":%lld,\"held_us\":%lld",
+        g_replay.count, g_replay.speed, (long long)(elapsed / 1000),
+        (long long)(g_replay.held_ns / 1000));
+    for (int t = 0; t < RECORD_TYPE_COUNT; t++) {
+        const struct histogram *lag = &g_replay.lag[t], *handle = &g_replay.handle[t];
+        if (!lag->total) continue;
+        printf(",\"%s\":{\"count\":%llu,\"lag_ns\":{\"p50\":%llu,\"p99\":%llu,\"max\":%llu},"
+            "\"handle_ns\":{\"p50\":%llu,\"p99\":%llu,\"max\":%llu}}",
+            record_type_names[t], (unsigned long long)lag->total,
+            (unsigned long long)hist_percentile(lag, 50),
+            (unsigned long long)hist_percentile(lag, 99), (unsigned long long)lag->max,
+            (unsigned long long)hist_percentile(handle, 50),
+            (unsigned long long)hist_percentile(handle, 99), (unsigned long long)handle->max);
+    }
+    printf("}\n");
+    fflush(stdout);
+    TRACE(EV_REPLAY_DONE, g_replay.count, elapsed / 1000);
+}
+
+/* Dispatches everything due; as fast as possible, one event per loop
+ * iteration so clients get their turn in between and lag is what a
+ * queued event waits for the loop */
+static int replay_timer(int fd, uint32_t mask, void *data) {
+    struct server *s = data;
+    uint64_t expirations;
+    ssize_t n = read(fd, &expirations, sizeof(expirations));
+    (void)n;
     
-    output->frame.notify = output_frame;
-    wl_signal_add(&wlr_output->events.frame, &output->frame);
-    output->destroy.notify = output_destroy;
-    wl_signal_add(&wlr_output->events.destroy, &output->destroy);
+    /* Keys before the keymap would miss the bindings they hit when recorded */
+    if (!startup_deferred_done(s)) {
+        replay_arm(now_ns() + NSEC_PER_MSEC);
+        return 0;
+    }
+    if (!g_replay.start_ns) {
+        g_replay.start_ns = g_replay.base_ns = g_replay.due_ns = now_ns();
+    }
     
-    wlr_output_layout_add_auto(s->output_layout, wlr_output);
-    output->scene_output = wlr_scene_output_create(s->scene, wlr_output);
+    while (g_replay.next < g_replay.count) {
+        const struct input_record *rec = &g_replay.records[g_replay.next];
+        int64_t now = now_ns();
+        int64_t due = g_replay.speed > 0 ?
+            g_replay.base_ns + (int64_t)(rec->ts_ns / g_replay.speed) : g_replay.due_ns;
+        if (due > now) {
+            replay_arm(due);
+            return 0;
+        }
+        
+        /* Time spent waiting for a client shifts everything after it */
+        if (rec->type == REC_VIEW_MAPPED && g_replay.views_mapped <= g_replay.views_expected) {
+            if (!g_replay.hold_ns) g_replay.hold_ns = now;
+            int64_t give_up = g_replay.hold_ns + REPLAY_MAP_WAIT_MS * NSEC_PER_MSEC;
+            if (now < give_up) {
+                replay_arm(give_up);
+                return 0;
+            }
+        }
+        if (g_replay.hold_ns) {
+            int64_t held = now - g_replay.hold_ns;
+            TRACE(EV_REPLAY_HOLD, g_replay.next, held / NSEC_PER_MSEC, g_replay.views_mapped);
+            g_replay.held_ns += held;
+            g_replay.base_ns += held;
+            g_replay.hold_ns = 0;
+            due = now;
+        }
+        
+        replay_dispatch(s, rec);
+        int64_t done = now_ns();
+        int type = rec->type < RECORD_TYPE_COUNT ? rec->type : 0;
+        hist_record(&g_replay.lag[type], now - due);
+        hist_record(&g_replay.handle[type], done - now);
+        TRACE(EV_REPLAY_EVENT, g_replay.next, rec->type, now - due, done - now);
+        g_replay.next++;
+        
+        if (g_replay.speed <= 0) {
+            g_replay.due_ns = done;
+            replay_arm(done);
+            return 0;
+        }
+    }
+    
+    replay_report();
+    wl_event_source_remove(g_replay.source);
+    g_replay.source = NULL;
+    wl_display_terminate(s->display);
+    return 0;
+}
+
+/* After the backend started: plug in the virtual devices and go */
+static void replay_start(struct server *s) {
+    g_replay.timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (g_replay.timer_fd < 0) return;
+    g_replay.source = wl_event_loop_add_fd(wl_display_get_event_loop(s->display),
+        g_replay.timer_fd, WL_EVENT_READABLE, replay_timer, s);
     
-    s->outputs[s->output_count++] = output;
+    wlr_keyboard_init(&g_replay.keyboard, &replay_keyboard_impl, replay_keyboard_impl.name);
+    wlr_pointer_init(&g_replay.pointer, &replay_pointer_impl, replay_pointer_impl.name);
+    g_replay.devices = true;
+    wl_signal_emit_mutable(&s->backend->events.new_input, &g_replay.keyboard.base);
+    wl_signal_emit_mutable(&s->backend->events.new_input, &g_replay.pointer.base);
     
-    fprintf(stderr, "[OUTPUT] %s added (%d total)\n", wlr_output->name, s->output_count);
+    replay_arm(now_ns());
+}
+
+static void replay_finish(void) {
+    if (g_replay.source) wl_event_source_remove(g_replay.source);
+    if (g_replay.timer_fd >= 0) close(g_replay.timer_fd);
+    if (g_replay.devices) {
+        wlr_keyboard_finish(&g_replay.keyboard);
+        wlr_pointer_finish(&g_replay.pointer);
+    }
+    if (g_replay.map) munmap(g_replay.map, g_replay.map_size);
 }
 
 static void handle_signal(int sig) {
@@ -596,41 +5903,118 @@ int main(void) {
     wlr_log_init(WLR_ERROR, NULL);
     
     struct server *s = &g_server;
-    s->num_workspaces = 4;
+    s->startup_ns[PHASE_MAIN] = now_ns();
     s->output_count = 0;
-    s->view_count = 0;
+    s->views.free_head = VIEW_NONE;
     s->keyboard_count = 0;
+    s->ipc_fd = -1;
+    
+    config_path(s->config_path, sizeof(s->config_path));
+    config_load_startup(s);
+    bindings_compile(&s->bindings, &s->config);
+    launcher_start(s);
+    
+    const char *env = getenv("ELDINWM_HEADLESS_REFRESH");
+    s->headless_refresh_mhz = env ? atoi(env) * 1000 : 0;
+    env = getenv("ELDINWM_BENCH");
+    s->bench_switches = env ? (atoi(env) > 0 ? atoi(env) : 100) : 0;
+    
+    /* ELDINWM_TRACE="" disables tracing */
+    env = getenv("ELDINWM_TRACE");
+    if (env) {
+        snprintf(s->trace_path, sizeof(s->trace_path), "%s", env);
+    } else {
+        const char *runtime = getenv("XDG_RUNTIME_DIR");
+        snprintf(s->trace_path, sizeof(s->trace_path), "%s/eldinwm.trace",
+            runtime ? runtime : "/tmp");
+    }
+    if (s->trace_path[0]) trace_init(s->trace_path);
+    startup_mark(s, PHASE_CONFIG);
+    
+    /* Input recording, or a replay of one on the headless backend */
+    env = getenv("ELDINWM_RECORD");
+    if (env && env[0]) record_init(env);
+    env = getenv("ELDINWM_REPLAY");
+    if (env && env[0] && !replay_load(env)) return 1;
+    env = getenv("ELDINWM_REPLAY_SPEED");
+    g_replay.speed = env ? atof(env) : 1.0;
+    
+    env = getenv("ELDINWM_STATS");
+    if (env) {
+        snprintf(s->stats_path, sizeof(s->stats_path), "%s", env);
+    } else {
+        const char *runtime = getenv("XDG_RUNTIME_DIR");
+        snprintf(s->stats_path, sizeof(s->stats_path), "%s/eldinwm.stats",
+            runtime ? runtime : "/tmp");
+    }
     
     signal(SIGINT, handle_signal);
     signal(SIGTERM, handle_signal);
-    signal(SIGCHLD, SIG_IGN);
     
     s->display = wl_display_create();
-    s->backend = wlr_backend_autocreate(wl_display_get_event_loop(s->display), NULL);
+    if (s->launcher_fd >= 0) {
+        s->launcher_source = wl_event_loop_add_fd(wl_display_get_event_loop(s->display),
+            s->launcher_fd, WL_EVENT_READABLE, launcher_event, s);
+    }
+    if (g_replay.records) {
+        s->backend = wlr_headless_backend_create(wl_display_get_event_loop(s->display));
+    } else {
+        s->backend = wlr_backend_autocreate(wl_display_get_event_loop(s->display), NULL);
+    }
     s->renderer = wlr_renderer_autocreate(s->backend);
     wlr_renderer_init_wl_display(s->renderer, s->display);
     s->allocator = wlr_allocator_autocreate(s->backend, s->renderer);
+    startup_mark(s, PHASE_RENDERER);
     
-    wlr_compositor_create(s->display, 5, s->renderer);
+    s->compositor = wlr_compositor_create(s->display, 5, s->renderer);
     wlr_data_device_manager_create(s->display);
     
     s->output_layout = wlr_output_layout_create(s->display);
     s->scene = wlr_scene_create();
     s->scene_layout = wlr_scene_attach_output_layout(s->scene, s->output_layout);
+    s->layout_change.notify = layout_change;
+    wl_signal_add(&s->output_layout->events.change, &s->layout_change);
     
-    /* Background */
+    /* Solid background, covered per output once an image is ready */
     struct wlr_scene_tree *bg = wlr_scene_tree_create(&s->scene->tree);
     wlr_scene_node_lower_to_bottom(&bg->node);
     float col[4] = {0.0, 0.05, 0.15, 1.0};
     wlr_scene_rect_create(bg, 8192, 8192, col);
     
-    s->xdg_shell = wlr_xdg_shell_create(s->display, 3);
+    bg_init(s);
+    config_watch(s);
+    pressure_init(s);
+    cmd_index_init(s);
+    
+    s->xdg_shell = wlr_xdg_shell_create(s->display, 6);
+    
+    /* Presentation feedback for client pacing, and the hints the tearing
+     * policy reads on every frame */
+#if WLR_VERSION_NUM >= ((0 << 16) | (19 << 8) | 0)
+    wlr_presentation_create(s->display, s->backend, 2);
+#else
+    /* Before 0.19 the scene only sends feedback if handed the global */
+    wlr_scene_set_presentation(s->scene, wlr_presentation_create(s->display, s->backend));
+#endif
+    s->tearing_control = wlr_tearing_control_manager_v1_create(s->display, 1);
+    s->content_type = wlr_content_type_manager_v1_create(s->display, 1);
+    
+    /* Capture. wlroots copies from the buffer each output commits, so a
+     * copy costs nothing unless the client's frame is due: with_damage
+     * requests wait for damage and only report the changed region, and
+     * dmabuf targets are filled by a GPU blit with no CPU readback.
+     * export-dmabuf hands out the committed buffer itself. */
+    wlr_screencopy_manager_v1_create(s->display);
+    wlr_export_dmabuf_manager_v1_create(s->display);
+#ifdef HAVE_EXT_IMAGE_CAPTURE
+    wlr_ext_image_copy_capture_manager_v1_create(s->display, 1);
+    wlr_ext_output_image_capture_source_manager_v1_create(s->display, 1);
+#endif
     s->new_xdg_surface.notify = new_xdg_surface;
     wl_signal_add(&s->xdg_shell->events.new_surface, &s->new_xdg_surface);
     
     s->cursor = wlr_cursor_create();
     wlr_cursor_attach_output_layout(s->cursor, s->output_layout);
-    s->cursor_mgr = wlr_xcursor_manager_create(NULL, 24);
     
     s->cursor_motion.notify = cursor_motion;
     wl_signal_add(&s->cursor->events.motion, &s->cursor_motion);
@@ -640,6 +6024,9 @@ int main(void) {
     wl_signal_add(&s->cursor->events.button, &s->cursor_button);
     s->cursor_axis.notify = cursor_axis;
     wl_signal_add(&s->cursor->events.axis, &s->cursor_axis);
+    s->pointer_timer = wl_event_loop_add_timer(wl_display_get_event_loop(s->display),
+        pointer_timeout, s);
+    s->relative_pointer = wlr_relative_pointer_manager_v1_create(s->display);
     s->cursor_frame.notify = cursor_frame;
     wl_signal_add(&s->cursor->events.frame, &s->cursor_frame);
     
@@ -652,36 +6039,74 @@ int main(void) {
     s->new_input.notify = new_input;
     wl_signal_add(&s->backend->events.new_input, &s->new_input);
     
+    known_outputs_load(s);
+    s->output_manager = wlr_output_manager_v1_create(s->display);
+    s->output_manager_apply.notify = output_manager_apply;
+    wl_signal_add(&s->output_manager->events.apply, &s->output_manager_apply);
+    s->output_manager_test.notify = output_manager_test;
+    wl_signal_add(&s->output_manager->events.test, &s->output_manager_test);
+    
     s->new_output.notify = new_output;
     wl_signal_add(&s->backend->events.new_output, &s->new_output);
     
+    /* The environment is final once the sockets exist, so the startup
+     * worker can go; it overlaps device discovery and the first modeset */
     const char *socket = wl_display_add_socket_auto(s->display);
-    if (!socket || !wlr_backend_start(s->backend)) {
+    if (!socket) {
         fprintf(stderr, "Failed to start\n");
         return 1;
     }
-    
+    startup_mark(s, PHASE_SOCKET);
     setenv("WAYLAND_DISPLAY", socket, 1);
+    launcher_setenv(s, "WAYLAND_DISPLAY", socket);
+    ipc_init(s, socket);
+#if WLR_HAS_XWAYLAND
+    xwayland_init(s);
+#endif
+    prep_start(s);
     
-    fprintf(stderr, "\n");
-    fprintf(stderr, "══════════════════════════════════════\n");
-    fprintf(stderr, "       ElDinWM - Ready                \n");
-    fprintf(stderr, "══════════════════════════════════════\n");
-    fprintf(stderr, "\n");
-    fprintf(stderr, "WAYLAND_DISPLAY=%s\n", socket);
-    fprintf(stderr, "Workspaces: %d\n", s->num_workspaces);
-    fprintf(stderr, "\n");
-    fprintf(stderr, "KEYS:\n");
-    fprintf(stderr, "  Ctrl+Shift+Left/Right - Switch WS\n");
-    fprintf(stderr, "  Ctrl+Shift+Z          - Command box\n");
-    fprintf(stderr, "  Ctrl+Shift+X          - Cycle focus\n");
-    fprintf(stderr, "  Ctrl+Shift+Down       - Exit\n");
-    fprintf(stderr, "\n");
+    if (!wlr_backend_start(s->backend)) {
+        fprintf(stderr, "Failed to start\n");
+        prep_finish();
+        return 1;
+    }
+    startup_mark(s, PHASE_BACKEND);
+    if (g_replay.records) replay_start(s);
+    
+    wl_event_loop_add_signal(wl_display_get_event_loop(s->display),
+        SIGUSR2, stats_signal, s);
+    
+    if (s->bench_switches > 0) {
+        wl_event_loop_add_signal(wl_display_get_event_loop(s->display),
+            SIGUSR1, bench_switch_storm, s);
+        printf("{\"event\":\"ready\",\"socket\":\"%s\",\"pid\":%d}\n",
+            socket, (int)getpid());
+        fflush(stdout);
+    }
     
     s->running = true;
     wl_display_run(s->display);
     
+    prep_finish();
+    replay_finish();
+#if WLR_HAS_XWAYLAND
+    xwayland_finish(s);
+#endif
+    ipc_finish(s);
+    s->output_manager = NULL;       /* goes away with the display */
     wl_display_destroy(s->display);
+    view_pool_finish(&s->views);
+    if (s->launcher_fd >= 0) {
+        close(s->launcher_fd);
+        waitpid(s->launcher_pid, NULL, 0);
+    }
+    if (s->keymap) xkb_keymap_unref(s->keymap);
+    if (s->xkb_context) xkb_context_unref(s->xkb_context);
+    bg_finish();
+    font_unload();
+    cmd_index_finish(s);
+    record_finish();
+    trace_finish();
     fprintf(stderr, "\nElDinWM: Exit\n");
     return 0;
 }